@@ -20,6 +20,7 @@
 
 #include "minar/minar.h"
 #include "core-util/ExtendablePoolAllocator.h"
+#include "core-util/CriticalSectionLock.h"
 #include "core-util/assert.h"
 #include "minar/trace.h"
 
@@ -42,15 +43,49 @@
 #define YOTTA_CFG_MINAR_ADDITIONAL_EVENT_POOLS_SIZE 100
 #endif
 
+/**
+ * Growing the pool in the middle of dispatching callbacks takes time, so it
+ * can be done in advance instead:
+ *  - MINAR_PREWARM_EVENT_POOL_SIZE: grow the pool to hold at least this many
+ *    callbacks when the scheduler is first initialised.
+ *  - MINAR_ADAPTIVE_EVENT_POOL: while the scheduler is idle, make sure that
+ *    there is room in the pool for the largest burst of allocations seen so
+ *    far (growing it one increment at a time, with interrupts enabled).
+ *
+ * Memory in the pool is never released once the pool has grown.
+ */
+#ifndef YOTTA_CFG_MINAR_PREWARM_EVENT_POOL_SIZE
+#define YOTTA_CFG_MINAR_PREWARM_EVENT_POOL_SIZE 0
+#endif
+#ifndef YOTTA_CFG_MINAR_ADAPTIVE_EVENT_POOL
+#define YOTTA_CFG_MINAR_ADAPTIVE_EVENT_POOL 0
+#endif
+
+/**
+ * When MINAR_DURATION_AWARE is enabled, the scheduler learns how long each
+ * callback takes to execute, and uses that to avoid dispatching a long
+ * callback just before one with a tighter deadline if it can wait.
+ */
+#ifndef YOTTA_CFG_MINAR_DURATION_AWARE
+#define YOTTA_CFG_MINAR_DURATION_AWARE 0
+#endif
+
 namespace minar{
 /// Callbacks are stored as a sorted tree of these, currently just ordered by
 /// 'call_before', which enables a very simple form of coalescing. To do much
-/// better we need to estimate or learn how long each call will take, and use
-/// something like a proper interval tree.
+/// better we need to estimate or learn how long each call will take (see
+/// MINAR_DURATION_AWARE, which uses this to re-order callbacks that are due
+/// at the same time), and use something like a proper interval tree.
 struct CallbackNode {
     CallbackNode()
       : cb(), call_before(0), tolerance(0),
-        interval(0){
+        interval(0), successor(NULL), next_ready(NULL),
+        waiting_for(0), abandoned(false), join(false), unchained(false),
+        payload(NULL)
+#if YOTTA_CFG_MINAR_DURATION_AWARE
+        , duration_x8(0)
+#endif
+    {
     }
     CallbackNode(
         minar::callback_t cb,
@@ -58,21 +93,34 @@ struct CallbackNode {
         minar::tick_t tolerance,
         minar::tick_t interval
     ) : cb(cb), call_before(call_before), tolerance(tolerance),
-        interval(interval){
+        interval(interval), successor(NULL), next_ready(NULL),
+        waiting_for(0), abandoned(false), join(false), unchained(false),
+        payload(NULL)
+#if YOTTA_CFG_MINAR_DURATION_AWARE
+        , duration_x8(0)
+#endif
+    {
+    }
+    ~CallbackNode(){
+        if(payload){
+            releasePayload(payload);
+        }
     }
     static void* operator new(std::size_t size){
         ytTraceMem("CallbackNode alloc %u\n", size);
         (void)size;
-        void *p = get_allocator()->alloc();
+        void *p = allocate(false);
         if (NULL == p) {
             CORE_UTIL_RUNTIME_ERROR("Unable to allocate CallbackNode");
         }
+        ytTraceRecord(trace::Trace_Pool_Alloc, ytTracePtr(p), 0);
         return p;
     }
 
     static void operator delete(void *p){
         ytTraceMem("CallbackNode free %u\n", sizeof(CallbackNode));
-        get_allocator()->free(p);
+        ytTraceRecord(trace::Trace_Pool_Free, ytTracePtr(p), 0);
+        deallocate(p, false);
     }
 
     /// The callback pointer
@@ -91,6 +139,167 @@ struct CallbackNode {
     /// 0 means do not repeat
     minar::tick_t     interval;
 
+    /// Chained callbacks (see CallbackAdder::then()): when this callback
+    /// completes, 'successor' is dispatched next (once all of the callbacks it
+    /// is waiting for have completed) through the ready list, without going
+    /// through the dispatch tree.
+    CallbackNode*     successor;
+    CallbackNode*     next_ready;
+
+    /// For successors, the number of callbacks this one is still waiting
+    /// for, and whether any of those were cancelled (in which case this one
+    /// is discarded instead of being dispatched)
+    uint16_t          waiting_for;
+    bool              abandoned : 1;
+
+    /// Joins (see Scheduler::postJoin()) are created waiting for a fixed
+    /// number of callbacks, rather than counting them as they are chained.
+    /// Until something is chained before it, a join is 'unchained', and kept
+    /// (through 'next_ready') on a list of joins that can still be cancelled.
+    bool              join : 1;
+    bool              unchained : 1;
+
+    /// Storage in the payload arena used by the bound callback (see
+    /// Scheduler::post(void (*)(T&), T const&)), released with the node.
+    minar::PayloadHeader* payload;
+
+#if YOTTA_CFG_MINAR_DURATION_AWARE
+    /// Moving average of how long the callback takes to execute, with 3
+    /// extra bits of precision. 0 until the first sample: after that it is
+    /// never less than 1, even for callbacks that take no time at all.
+    minar::tick_t     duration_x8;
+
+    bool hasDurationSample() const{
+        return duration_x8 != 0;
+    }
+    minar::tick_t estimatedDuration() const{
+        return duration_x8 / 8;
+    }
+    void addDurationSample(minar::tick_t duration){
+        // the first sample is taken as is, after that each one has a weight
+        // of 1/8
+        duration_x8 = duration_x8? duration_x8 - duration_x8/8 + duration : duration * 8;
+        if(!duration_x8)
+            duration_x8 = 1;
+    }
+#endif
+
+    /// Allocate from the pool, keeping track of its usage. 'early' is set
+    /// when allocating only to make the pool grow in advance: those nodes are
+    /// counted separately, so that callbacks posted (from interrupt handlers)
+    /// while the pool is growing see the real usage of the pool.
+    static void* allocate(bool early){
+        void *p = get_allocator()->alloc();
+        if (NULL != p) {
+            mbed::util::CriticalSectionLock lock;
+            PoolState& pool = get_pool_state();
+            if (early) {
+                pool.reserved++;
+            } else {
+                pool.stats.in_use++;
+            }
+            if (pool.stats.in_use + pool.reserved > pool.stats.capacity) {
+                // the allocator has just added another pool
+                pool.stats.capacity += YOTTA_CFG_MINAR_ADDITIONAL_EVENT_POOLS_SIZE;
+                if (early) {
+                    pool.stats.early_growths++;
+                } else {
+                    pool.stats.growths++;
+                }
+            }
+            if (!early) {
+                if (pool.stats.in_use > pool.stats.high_water) {
+                    pool.stats.high_water = pool.stats.in_use;
+                }
+                if (pool.stats.in_use - pool.idle_in_use > pool.largest_burst) {
+                    pool.largest_burst = pool.stats.in_use - pool.idle_in_use;
+                }
+            }
+        }
+        return p;
+    }
+
+    static void deallocate(void *p, bool early){
+        get_allocator()->free(p);
+        mbed::util::CriticalSectionLock lock;
+        if (early) {
+            get_pool_state().reserved--;
+        } else {
+            get_pool_state().stats.in_use--;
+        }
+    }
+
+    /// Grow the pool (if necessary) so that it can hold at least 'nodes'
+    /// callbacks. The allocator only grows when it is full, so this fills it
+    /// up, and then frees everything that was allocated. Returns false if the
+    /// pool couldn't grow that much (because the heap is exhausted).
+    static bool reserve(uint32_t nodes){
+        void *allocated = NULL;
+        while (get_pool_state().stats.capacity < nodes) {
+            void *p = allocate(true);
+            if (NULL == p) {
+                break;
+            }
+            // keep a list of what we've allocated in the nodes themselves
+            *(void**)p = allocated;
+            allocated = p;
+        }
+        while (allocated != NULL) {
+            void *next = *(void**)allocated;
+            deallocate(allocated, true);
+            allocated = next;
+        }
+        return get_pool_state().stats.capacity >= nodes;
+    }
+
+    /// Called when the scheduler is idle. Returns true if there is pool
+    /// maintenance to do (which should be done by calling maintain(), with
+    /// interrupts enabled)
+    static bool idle(){
+        PoolState& pool = get_pool_state();
+        // bursts are measured from the last time the scheduler was idle
+        pool.idle_in_use = pool.stats.in_use;
+#if YOTTA_CFG_MINAR_ADAPTIVE_EVENT_POOL
+        return pool.stats.capacity - pool.stats.in_use < pool.largest_burst;
+#else
+        return false;
+#endif
+    }
+
+    /// Make room for the largest burst seen so far. This grows the pool by at
+    /// most one increment, so that it doesn't take too long.
+    static void maintain(){
+        PoolState& pool = get_pool_state();
+        if (pool.stats.capacity - pool.stats.in_use < pool.largest_burst) {
+            if (!reserve(pool.stats.capacity + 1)) {
+                // The pool can't grow: settle for the room there is, so that
+                // idle() stops asking for maintenance (otherwise the scheduler
+                // would fill and empty the pool forever instead of sleeping).
+                // A larger burst later on will try again.
+                mbed::util::CriticalSectionLock lock;
+                pool.largest_burst = pool.stats.capacity - pool.stats.in_use;
+            }
+        }
+    }
+
+    struct PoolState{
+        minar::PoolStats stats;
+        /// pool usage the last time the scheduler was idle, and the most that
+        /// has been allocated since an idle period
+        uint32_t         idle_in_use;
+        uint32_t         largest_burst;
+        /// nodes held by reserve() while it grows the pool
+        uint32_t         reserved;
+    };
+
+    static PoolState& get_pool_state(){
+        // constant-initialised, so this is valid before the allocator exists
+        static PoolState state = {
+            {0, 0, YOTTA_CFG_MINAR_INITIAL_EVENT_POOL_SIZE, 0, 0}, 0, 0, 0
+        };
+        return state;
+    }
+
     static mbed::util::ExtendablePoolAllocator *get_allocator() {
         static mbed::util::ExtendablePoolAllocator *allocator = NULL;
 
@@ -25,6 +25,8 @@
 #include "core-util/Event.h"
 #include "core-util/FunctionPointer.h"
 
+#include <new>
+
 namespace minar{
 
 /// @name Types
@@ -40,6 +42,13 @@ enum Constants{
     // warn if the event loop is lagging (all callbacks are being executed late
     // because there is too much to do) by more than this
     Warn_Lag_Milliseconds = 500,
+    /// Largest payload (sizeof(T)) that can be posted with
+    /// postCallback(void (*)(T&), T const&). The largest blocks of the
+    /// payload arena are 256 bytes, which leaves room for the block header
+    /// and alignment on any platform.
+    Max_Payload_Size = 224,
+    /// Largest block allocated from the payload arena
+    Max_Payload_Block_Size = 256,
 };
 
 /// Basic callback type
@@ -51,6 +60,187 @@ typedef platform::tick_t tick_t;
 /// Handle onto scheduled callbacks
 typedef void* callback_handle_t;
 
+#if __cplusplus >= 201103L
+/// A strongly typed duration, stored in ticks. Durations are normally created
+/// with the _ms and _s literals (see minar::literals below), which convert to
+/// ticks at compile time:
+///
+///     using namespace minar::literals;
+///     minar::Scheduler::postCallback(f).period(50_ms).tolerance(2_ms);
+class Duration{
+    public:
+        constexpr explicit Duration(tick_t ticks)
+            : m_ticks(ticks){
+        }
+        constexpr tick_t ticks() const{
+            return m_ticks;
+        }
+    private:
+        tick_t m_ticks;
+};
+
+namespace detail{
+constexpr bool isDecimal(){
+    return true;
+}
+template<typename... Rest>
+constexpr bool isDecimal(char c, Rest... rest){
+    return c >= '0' && c <= '9' && isDecimal(rest...);
+}
+constexpr uint64_t parseDecimal(uint64_t value){
+    return value;
+}
+template<typename... Rest>
+constexpr uint64_t parseDecimal(uint64_t value, char c, Rest... rest){
+    return parseDecimal(value * 10 + (c - '0'), rest...);
+}
+constexpr uint64_t toTicks(uint64_t value, uint64_t per_second){
+    return (value * (uint64_t)minar::platform::Time_Base) / per_second;
+}
+} // namespace detail
+
+namespace literals{
+/// a duration in milliseconds, e.g. 50_ms
+template<char... Digits>
+constexpr Duration operator"" _ms(){
+    static_assert(detail::isDecimal(Digits...) && sizeof...(Digits) <= 10, "Durations must be whole numbers of milliseconds.");
+    static_assert(detail::toTicks(detail::parseDecimal(0, Digits...), 1000) < minar::platform::Time_Mask, "Duration greater than time wrap-around.");
+    return Duration((tick_t)detail::toTicks(detail::parseDecimal(0, Digits...), 1000));
+}
+
+/// a duration in seconds, e.g. 2_s
+template<char... Digits>
+constexpr Duration operator"" _s(){
+    static_assert(detail::isDecimal(Digits...) && sizeof...(Digits) <= 10, "Durations must be whole numbers of seconds.");
+    static_assert(detail::toTicks(detail::parseDecimal(0, Digits...), 1) < minar::platform::Time_Mask, "Duration greater than time wrap-around.");
+    return Duration((tick_t)detail::toTicks(detail::parseDecimal(0, Digits...), 1));
+}
+} // namespace literals
+#endif // __cplusplus >= 201103L
+
+/// Statistics on how accurately the scheduler wakes up from sleep, collected
+/// when MINAR_WAKE_CALIBRATION is enabled in yotta config (otherwise they are
+/// all zero).
+struct WakeStats{
+    enum{
+        Histogram_Buckets = 8
+    };
+    /// current estimate of the wake-up latency: timed sleeps are ended this
+    /// much earlier than the time the next callback is due
+    tick_t   latency;
+    /// number of timed wake-ups measured
+    uint32_t samples;
+    /// number of times the scheduler waited without sleeping, because the
+    /// next callback was due sooner than it could wake up from sleep (each
+    /// wait counts once, however many times the loop checked the time)
+    uint32_t spins;
+    /// how late timed wake-ups were compared to the time the next callback
+    /// was due: bucket 0 counts wake-ups on time, bucket i (i > 0) wake-ups
+    /// between 2^(i-1) and 2^i - 1 ticks late, and the last bucket also counts
+    /// everything later than that
+    uint32_t histogram[Histogram_Buckets];
+};
+
+/// How long the scheduler's dispatch loop keeps interrupts disabled for,
+/// collected when MINAR_MEASURE_MASKED_TIME is enabled in yotta config
+/// (otherwise they are all zero). Times are measured with the platform's tick
+/// timer, so they are only as precise as a tick.
+///
+/// The dispatch loop disables interrupts for one of the operations below at
+/// a time, and each of them does a bounded amount of work:
+///  - Mask_Pop: take the next due callback from the dispatch tree (one
+///    O(log n) removal from the binary heap; when MINAR_DURATION_AWARE swaps
+///    it with the callback after it, two removals and one insertion)
+///  - Mask_Ready: take the next callback from the ready list (constant time)
+///  - Mask_Sleep: check that nothing is due and go to sleep (constant time,
+///    plus the platform's sleep entry and exit)
+///  - Mask_Insert: re-insert a periodic callback (one O(log n) insertion)
+///  - Mask_Remove: cancel a callback (one O(log n) removal)
+/// so the longest time interrupts are disabled by the scheduler is bounded by
+/// the time to insert or remove one callback from a heap of all the queued
+/// callbacks (three times that with MINAR_DURATION_AWARE).
+///
+/// Chained callbacks (see CallbackAdder::then()) also disable interrupts,
+/// but these sections aren't measured: chaining a callback, and releasing
+/// or discarding each successor when a callback completes, take constant
+/// time; chaining a join that hasn't been chained after anything yet, and
+/// cancelling a callback that isn't queued, take time proportional to the
+/// number of such joins.
+struct MaskStats{
+    enum Operation{
+        Mask_Pop,
+        Mask_Ready,
+        Mask_Sleep,
+        Mask_Insert,
+        Mask_Remove,
+        Mask_Operations
+    };
+    enum{
+        Histogram_Buckets = 8
+    };
+    /// the longest time interrupts were disabled for each operation
+    tick_t   longest[Mask_Operations];
+    /// for each operation, bucket 0 counts the times interrupts were disabled
+    /// for less than a tick, bucket i (i > 0) the times they were disabled for
+    /// between 2^(i-1) and 2^i - 1 ticks, and the last bucket also counts
+    /// everything longer than that
+    uint32_t histogram[Mask_Operations][Histogram_Buckets];
+};
+
+/// Usage of the pool that the storage for callbacks is allocated from
+/// (shared by all scheduler instances)
+struct PoolStats{
+    /// callbacks currently allocated
+    uint32_t in_use;
+    /// the most callbacks that have ever been allocated at once
+    uint32_t high_water;
+    /// callbacks that can be allocated before the pool next has to grow
+    uint32_t capacity;
+    /// number of times the pool had to grow to satisfy an allocation
+    uint32_t growths;
+    /// number of times the pool was grown in advance (when pre-warming, or
+    /// while the scheduler was idle)
+    uint32_t early_growths;
+};
+
+/// Payloads posted with postCallback(void (*)(T&), T const&) are copied into
+/// blocks of a scheduler-owned arena, which start with this header. The block
+/// belongs to the scheduled callback, and is freed (and the payload destroyed)
+/// when the callback has been dispatched for the last time or is cancelled.
+struct PayloadHeader{
+    void (*destroy)(PayloadHeader* block);
+    uint8_t size_class;
+};
+
+/// Allocate a block of at least 'size' bytes (at most Max_Payload_Block_Size)
+/// from the payload arena. Safe to call from interrupt handlers (where, as
+/// with the event pool, the arena may have to create or grow a pool). The
+/// block is raw memory: 'size_class' must be stored in the header of the
+/// object that is constructed in it.
+void* allocPayload(size_t size, uint8_t& size_class);
+
+/// Destroy a payload and return its block to the arena.
+void releasePayload(PayloadHeader* block);
+
+template<typename T>
+struct PayloadBlock : PayloadHeader{
+    PayloadBlock(void (*callback)(T&), T const& payload, uint8_t size_class)
+        : callback(callback), payload(payload){
+        destroy = &PayloadBlock::destroyBlock;
+        this->size_class = size_class;
+    }
+    static void call(PayloadHeader* block){
+        PayloadBlock* self = static_cast<PayloadBlock*>(block);
+        self->callback(self->payload);
+    }
+    static void destroyBlock(PayloadHeader* block){
+        static_cast<PayloadBlock*>(block)->~PayloadBlock();
+    }
+
+    void (*callback)(T&);
+    T payload;
+};
+
 class SchedulerData;
 
 class Scheduler{
@@ -62,12 +252,51 @@ class Scheduler{
                 CallbackAdder& tolerance(tick_t tolerance);
                 CallbackAdder& period(tick_t tolerance);
 
+#if __cplusplus >= 201103L
+                CallbackAdder& delay(Duration d){
+                    return delay(d.ticks());
+                }
+                CallbackAdder& tolerance(Duration d){
+                    return tolerance(d.ticks());
+                }
+                CallbackAdder& period(Duration d){
+                    return period(d.ticks());
+                }
+#endif
+
+                // Add a callback to be dispatched as soon as this one has
+                // completed (or, if then() has already been called, as soon
+                // as the last callback added with then() has completed), for
+                // example postCallback(a).then(b).then(c). The storage for
+                // the callback is allocated now, so no allocation happens
+                // when the chain is executed. If a callback in the chain is
+                // cancelled, the rest of the chain is discarded. A periodic
+                // callback never completes, so callbacks chained after it are
+                // never dispatched (they are discarded when it is cancelled).
+                // Must be called before getHandle(): once the callback has
+                // been posted, it may already have completed.
+                CallbackAdder& then(callback_t const& cb);
+
+                CallbackAdder& then(void (*callback)(void))
+                {
+                    return then(mbed::util::FunctionPointer(callback).bind());
+                }
+
+                // Make the last callback in this chain one of the callbacks
+                // that a join callback (see Scheduler::postJoin()) waits for.
+                CallbackAdder& then(callback_handle_t join);
+
                 callback_handle_t getHandle();
 
                 ~CallbackAdder();
 
             private:
                 CallbackAdder(Scheduler& sched, callback_t cb);
+                CallbackAdder(Scheduler& sched, callback_t cb, bool continuation, PayloadHeader* payload);
+
+                // discard a chain that will never be dispatched, as if the
+                // callback it follows had been cancelled
+                void discard(callback_handle_t head);
 
                 Scheduler&   m_sched;
                 callback_t   m_cb;
@@ -75,8 +304,101 @@ class Scheduler{
                 tick_t       m_delay;
                 tick_t       m_period;
                 bool         m_posted;
+                bool         m_continuation;
+                // the first and last callbacks added with then()
+                callback_handle_t m_chain_head;
+                callback_handle_t m_chain_tail;
+                // payload (if any) owned by the callback
+                PayloadHeader* m_payload;
         };
     public:
+        // Create an independent scheduler, with its own queue of callbacks.
+        // Callbacks are posted to it with post() and dispatched by run().
+        // The static functions below operate on the default scheduler
+        // returned by instance(), which is the one used by mbed OS, except
+        // for postContinuation() and getTime(), which operate on the
+        // scheduler that is running (if any).
+        Scheduler();
+
+        // Any callbacks still queued on the scheduler are discarded. Must not
+        // be called while run() is executing.
+        ~Scheduler();
+
+        /// @name Per-instance API
+        /// These are equivalent to the static functions of the same meaning
+        /// below, but operate on this instance.
+
+        /// start dispatching callbacks from this scheduler. Returns when
+        /// halt() is called, with the number of items in the queue.
+        int run();
+
+        /// stop dispatching callbacks from this scheduler (even if there is
+        /// still work to do), returns the number of items in the queue.
+        int halt();
+
+        CallbackAdder post(callback_t const& cb);
+
+        CallbackAdder post(void (*callback)(void))
+        {
+            return post(mbed::util::FunctionPointer(callback).bind());
+        }
+
+        template<typename T>
+        CallbackAdder post(T *object, void (T::*member)())
+        {
+            return post(mbed::util::FunctionPointer(object, member).bind());
+        }
+
+        /// post the next step of a sequence from one of this scheduler's
+        /// callbacks (see postContinuation())
+        CallbackAdder continuation(callback_t const& cb);
+
+        /// create a join callback on this scheduler (see postJoin())
+        callback_handle_t join(callback_t const& cb, uint16_t predecessors);
+
+        // Post a callback with an argument too large to be bound into a
+        // callback_t (up to Max_Payload_Size bytes). The payload is copied
+        // into a block of memory owned by the scheduler, which is passed to
+        // the callback by reference each time it is called, and destroyed
+        // when the callback has been dispatched for the last time or is
+        // cancelled. (So the payload may be destroyed in an interrupt
+        // handler, if the callback is cancelled from one.)
+        template<typename T>
+        CallbackAdder post(void (*callback)(T&), T const& payload)
+        {
+            // a compile error here means that the payload is too large
+            typedef char payload_too_large[(sizeof(T) <= Max_Payload_Size)? 1 : -1];
+            (void)sizeof(payload_too_large);
+            // ... and here, that it is too strictly aligned to fit with the
+            // block header in the largest block
+            typedef char payload_block_too_large[(sizeof(PayloadBlock<T>) <= Max_Payload_Block_Size)? 1 : -1];
+            (void)sizeof(payload_block_too_large);
+
+            uint8_t size_class;
+            void* memory = allocPayload(sizeof(PayloadBlock<T>), size_class);
+            PayloadBlock<T>* block = new (memory) PayloadBlock<T>(callback, payload, size_class);
+            return CallbackAdder(
+                *this,
+                mbed::util::FunctionPointer1<void, PayloadHeader*>(&PayloadBlock<T>::call).bind(block),
+                false,
+                block
+            );
+        }
+
+        int cancel(callback_handle_t handle);
+
+        /// the scheduled execution time of the current callback of this
+        /// scheduler (see minar::getTime())
+        tick_t time() const;
+
+        /// statistics on the accuracy of this scheduler's wake-ups
+        WakeStats wakeStats() const;
+
+        /// statistics on how long this scheduler disables interrupts for
+        MaskStats maskStats() const;
+
+        /// @name Default instance API
+
         // get the global scheduler instance
         // The scheduler will be automatically initialised the first time it is
         // referenced.
@@ -121,14 +443,70 @@ class Scheduler{
             return postCallback(mbed::util::FunctionPointer(object, member).bind());
         }
 
+        // Function for posting the next step of a sequence of callbacks.
+        // When called from inside a (non-periodic) callback, the storage of
+        // the callback currently being dispatched is re-used for the new
+        // callback once the current one returns, so a chain of steps
+        // allocates no new scheduler memory.  Only one continuation can be
+        // posted per dispatch: if there is nothing to re-use (called from
+        // outside a callback, from a periodic callback, or a continuation is
+        // already pending) this behaves exactly like postCallback.
+        //
+        // Must only be called from the scheduler's own context (not from
+        // interrupt handlers). When called from a callback of a scheduler
+        // other than the default one, the continuation is posted to that
+        // scheduler (see continuation()).
+        //
+        // usage: postContinuation(nextStep).delay(minar::milliseconds(10));
+        static CallbackAdder postContinuation(callback_t const& cb);
+
+        static CallbackAdder postContinuation(void (*callback)(void))
+        {
+            return postContinuation(mbed::util::FunctionPointer(callback).bind());
+        }
+
+        // Create a callback that is dispatched once 'predecessors' callbacks
+        // that it has been chained after (with CallbackAdder::then(handle))
+        // have completed, for example:
+        //
+        //   callback_handle_t c = postJoin(transmit, 2);
+        //   postCallback(sampleA).then(c);
+        //   postCallback(sampleB).then(c);
+        //
+        // The join must be chained after exactly 'predecessors' callbacks:
+        // since the number is known in advance, it doesn't matter if some of
+        // them complete before the others have been chained. If one of them
+        // is cancelled, the join is discarded once the others have completed.
+        // A join that hasn't been chained after anything yet can be cancelled
+        // with cancelCallback(); otherwise it is never dispatched (or freed).
+        static callback_handle_t postJoin(callback_t const& cb, uint16_t predecessors);
+
+        // Function for posting callbacks with a payload that is too large
+        // to bind (see post(void (*)(T&), T const&))
+        template<typename T>
+        static CallbackAdder postCallback(void (*callback)(T&), T const& payload)
+        {
+            return instance()->post(callback, payload);
+        }
+
         static int cancelCallback(callback_handle_t handle);
 
+        static PoolStats getPoolStats();
+
+        // the scheduled execution time of the current callback of the
+        // scheduler that is running (see minar::getTime())
         static tick_t getTime();
 
     private:
+        // constructs the default instance, whose queue lives in the
+        // never-free heap
+        explicit Scheduler(bool persistent);
 
+        // not copyable
+        Scheduler(Scheduler const&);
+        Scheduler& operator=(Scheduler const&);
 
-        Scheduler();
+        void init(bool persistent);
 
         // [FPTR] this was a unique_ptr, what's the consequence of making it a simple pointer?
         SchedulerData* data;
@@ -149,6 +527,9 @@ uint32_t ticks(tick_t ticks);
 /// Note that this time is NOT monotonic. If callbacks are executed in an order
 /// different to their scheduled order because of the resources they need, then
 /// this time will jump backwards.
+///
+/// While a scheduler other than the default one is running, this is the time
+/// of that scheduler's current callback.
 tick_t getTime();
 
 
@@ -39,6 +39,18 @@ extern "C" {
 #define ytTraceDispatch(...) do{}while(0)
 #endif
 
+/* Binary tracing records scheduler events into a RAM ring buffer (see
+ * minar/trace_buffer.h). It is enabled by setting MINAR_TRACE_BUFFER_SIZE (the
+ * number of records, a power of two) in yotta config. */
+#ifdef YOTTA_CFG_MINAR_TRACE_BUFFER_SIZE
+#include "minar/trace_buffer.h"
+#define ytTraceRecord(type, a, b) minar::trace::record((type), (uint32_t)(a), (uint32_t)(b))
+#define ytTracePtr(p) ((uint32_t)(uintptr_t)(p))
+#else
+#define ytTraceRecord(type, a, b) do{}while(0)
+#define ytTracePtr(p) 0
+#endif
+
 /* Run time warnings are turned on by default only in debug builds
  * The user can override this behaviour by setting MINAR_NO_RUNTIME_WARNINGS
  * in yotta config. Example: yt build -d --config '{"MINAR_NO_RUNTIME_WARNINGS":1}' */
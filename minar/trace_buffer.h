@@ -0,0 +1,97 @@
+/*
+ * PackageLicenseDeclared: Apache-2.0
+ * Copyright (c) 2015 ARM Limited
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __MINAR_TRACE_BUFFER_H__
+#define __MINAR_TRACE_BUFFER_H__
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * Binary trace of the scheduler's activity.
+ *
+ * Each event is stored as a fixed-size record in a ring buffer in RAM, so
+ * recording one costs a timer read and a handful of stores, instead of the
+ * printf used by the text traces in minar/trace.h. Once the buffer is full the
+ * oldest records are overwritten.
+ *
+ * The buffer (a Header followed by the records) is the C symbol
+ * minar_trace_buffer, so it can be dumped with a debugger, or sent somewhere
+ * using getBuffer(). scripts/minar_trace.py converts a dump into a
+ * Chrome/Perfetto trace.
+ *
+ * To record a workload longer than the buffer, records can be drained
+ * periodically and streamed out after the Header: scripts/minar_replay.py
+ * replays such a recording through a model of the scheduler.
+ */
+namespace minar{
+namespace trace{
+
+enum Constants{
+    Trace_Magic   = 0x52544e4d, // "MNTR"
+    Trace_Version = 1,
+};
+
+/// Record types, and the meaning of the 'a' and 'b' fields of each
+enum RecordType{
+    Trace_Post           = 1, // a: handle, b: call_before
+    Trace_Cancel         = 2, // a: handle, b: 1 if cancelled, 0 if not
+    Trace_Dispatch_Start = 3, // a: handle, b: call_before
+    Trace_Dispatch_End   = 4, // a: handle
+    Trace_Sleep          = 5, // a: wake-up time, b: 1 if sleeping with no timeout
+    Trace_Wake           = 6, //
+    Trace_Pool_Alloc     = 7, // a: address
+    Trace_Pool_Free      = 8, // a: address
+    Trace_Post_Params    = 9, // follows Trace_Post, a: interval, b: tolerance
+};
+
+struct Record{
+    uint32_t time;      // minar::platform::getTime() when the record was written
+    uint8_t  type;      // RecordType
+    uint8_t  reserved[3];
+    uint32_t a;
+    uint32_t b;
+};
+
+struct Header{
+    uint32_t magic;         // Trace_Magic
+    uint16_t version;       // Trace_Version
+    uint16_t record_size;   // sizeof(Record)
+    uint32_t time_base;     // minar::platform::Time_Base (ticks per second)
+    uint32_t time_mask;     // minar::platform::Time_Mask
+    uint32_t capacity;      // number of records in the buffer
+    uint32_t written;       // number of records ever written (wraps)
+};
+
+/// Add a record to the buffer. Safe to call from interrupt handlers.
+void record(uint8_t type, uint32_t a, uint32_t b);
+
+/// Get the address and size (in bytes) of the whole buffer, header included.
+const void* getBuffer(size_t* size);
+
+/// Copy up to 'max' records that have not yet been drained into 'out',
+/// oldest first, returning the number copied. If records were overwritten
+/// before they could be drained, the number lost is added to *lost.
+size_t drain(Record* out, size_t max, uint32_t* lost);
+
+/// Discard all records.
+void clear();
+
+} // namespace trace
+} // namespace minar
+
+#endif // #ifndef __MINAR_TRACE_BUFFER_H__
@@ -0,0 +1,309 @@
+#!/usr/bin/env python
+#
+# PackageLicenseDeclared: Apache-2.0
+# Copyright (c) 2015 ARM Limited
+#
+# Licensed under the Apache License, Version 2.0 (the "License");
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#
+#     http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+
+"""Replay a workload recorded with minar's binary trace (see
+minar/trace_buffer.h) through a model of the scheduler, in virtual time, and
+report wakeups, lateness and queue and pool usage.
+
+With --duration-aware, the model also learns how long each callback takes (as
+the scheduler does when MINAR_DURATION_AWARE is enabled), and dispatches a
+short callback before a long one that would make it late. --compare replays
+the workload both ways.
+
+The recording provides the callbacks that were posted (with their delay,
+period and tolerance), the callbacks that were cancelled, and how long each
+dispatch took. Posts and cancels made while a callback was executing are
+replayed relative to the (simulated) execution of that callback; all others
+are replayed at the time they were recorded. The scheduling parameters can be
+changed with the options below to see their effect on the same workload.
+
+usage: minar_replay.py trace.bin [--stream] [--initial-pool N] [--pool-increment N]
+                       [--tolerance-ms T | --min-tolerance-ms T]
+                       [--duration-aware | --compare]
+"""
+
+import argparse
+import heapq
+import sys
+
+import minar_trace
+from minar_trace import POST, CANCEL, DISPATCH_START, DISPATCH_END, POST_PARAMS
+
+
+class Callback(object):
+    ''' One posted callback (one CallbackNode, from post until it is freed).
+    '''
+    def __init__(self, delay=0, interval=0, tolerance=0):
+        # from the post to the first deadline (which, for periodic
+        # callbacks, includes the first interval)
+        self.delay = delay
+        self.interval = interval
+        self.tolerance = tolerance
+        self.continuation = False
+        # durations of each dispatch, in ticks
+        self.durations = []
+        # posts and cancels made by each dispatch:
+        # {dispatch number: [(offset, action, callback)]}
+        self.actions = {}
+        self.first_call_before = None
+        self.dispatches = 0
+
+    def duration(self, n):
+        if n < len(self.durations):
+            return self.durations[n]
+        return self.durations[-1] if self.durations else 0
+
+
+def signedTicks(ticks, mask):
+    ticks &= mask
+    return ticks - (mask + 1) if ticks > mask // 2 else ticks
+
+
+def readWorkload(header, records):
+    ''' Turn trace records into a list of external (time, action, callback)
+        events; callbacks posted by other callbacks are attached to them.
+    '''
+    mask = header['time_mask']
+    external = []
+    live = {}
+    unpaired = []
+    dispatching = []
+    for t, (raw, kind, a, b) in zip(minar_trace.unwrapTicks(header, records), records):
+        def attach(action, cb):
+            if dispatching:
+                parent, n, start = dispatching[-1]
+                parent.actions.setdefault(n, []).append((t - start, action, cb))
+            else:
+                external.append((t, action, cb))
+
+        if kind == POST:
+            cb = Callback(delay=signedTicks(b - raw, mask))
+            cb.continuation = bool(dispatching) and dispatching[-1][0] is live.get(a)
+            unpaired.append((a, cb))
+        elif kind == POST_PARAMS and unpaired:
+            # posts from interrupt handlers nest, so params always belong to
+            # the most recent unpaired post
+            handle, cb = unpaired.pop()
+            cb.interval = a
+            cb.tolerance = b
+            live[handle] = cb
+            attach('post', cb)
+        elif kind == CANCEL and b and a in live:
+            attach('cancel', live.pop(a))
+        elif kind == DISPATCH_START:
+            cb = live.get(a)
+            if cb is None:
+                # posted before the recording started: assume it was posted
+                # just before it was dispatched, with the deadline it had
+                cb = live[a] = Callback(delay=signedTicks(b - raw, mask))
+                external.append((t, 'post', cb))
+            if cb.dispatches == 1 and not cb.interval and cb.first_call_before is not None:
+                # an unknown callback that repeats is periodic
+                cb.interval = signedTicks(b - cb.first_call_before, mask)
+            if cb.first_call_before is None:
+                cb.first_call_before = b
+            dispatching.append((cb, cb.dispatches, t))
+            cb.dispatches += 1
+        elif kind == DISPATCH_END and dispatching:
+            cb, n, start = dispatching.pop()
+            cb.durations.append(t - start)
+            if not cb.interval and live.get(a) is cb:
+                del live[a]
+    return external
+
+
+def percentile(values, p):
+    if not values:
+        return 0
+    values = sorted(values)
+    return values[min(len(values) - 1, int(p / 100.0 * len(values)))]
+
+
+class Simulation(object):
+    def __init__(self, external, args, time_base, duration_aware=False):
+        self.external = sorted(external, key=lambda e: e[0])
+        self.args = args
+        self.duration_aware = duration_aware
+        # learned durations of each callback, with 3 extra bits of precision
+        self.duration_x8 = {}
+        self.time_base = time_base
+        self.queue = []
+        self.queued = set()
+        self.seq = 0
+        self.in_pool = 0
+        self.peak_pool = 0
+        self.peak_queue = 0
+        self.lateness = []
+        self.timer_wakeups = 0
+        self.event_wakeups = 0
+
+    def ticks(self, ms):
+        return int(ms * self.time_base / 1000)
+
+    def tolerance(self, cb):
+        if self.args.tolerance_ms is not None:
+            return 2 * self.ticks(self.args.tolerance_ms)
+        return max(cb.tolerance, 2 * self.ticks(self.args.min_tolerance_ms))
+
+    def post(self, cb, now):
+        if not cb.continuation:
+            self.in_pool += 1
+            self.peak_pool = max(self.peak_pool, self.in_pool)
+        self.schedule(cb, now + cb.delay, 0)
+
+    def schedule(self, cb, call_before, n):
+        self.seq += 1
+        heapq.heappush(self.queue, (call_before, self.seq, cb, n))
+        self.queued.add(cb)
+        self.peak_queue = max(self.peak_queue, len(self.queued))
+
+    def cancel(self, cb):
+        if cb in self.queued:
+            self.queue = [e for e in self.queue if e[2] is not cb]
+            heapq.heapify(self.queue)
+            self.queued.discard(cb)
+            self.in_pool -= 1
+
+    def apply(self, action, cb, now):
+        if action == 'post':
+            self.post(cb, now)
+        else:
+            self.cancel(cb)
+
+    def estimatedDuration(self, cb):
+        return self.duration_x8.get(cb, 0) // 8
+
+    def learnDuration(self, cb, duration):
+        if cb in self.duration_x8:
+            self.duration_x8[cb] += duration - self.duration_x8[cb] // 8
+        else:
+            self.duration_x8[cb] = duration * 8
+
+    def dispatch(self, now):
+        entry = heapq.heappop(self.queue)
+        if self.duration_aware and self.queue:
+            # the same rule as the scheduler: run the next callback first if
+            # it is due, would be made late by this one, and is short enough
+            # not to make this one late
+            # (only once it has learned how long that one takes)
+            other = self.queue[0]
+            if (other[2] in self.duration_x8 and
+                    other[0] <= now + self.tolerance(other[2]) and
+                    other[0] >= now and
+                    now + self.estimatedDuration(entry[2]) > other[0] and
+                    now + self.estimatedDuration(other[2]) <= entry[0]):
+                entry = heapq.heapreplace(self.queue, entry)
+        call_before, _, cb, n = entry
+        self.queued.discard(cb)
+        self.lateness.append(max(0, now - call_before))
+        if cb.interval:
+            # re-scheduled before the callback runs, so that it can cancel itself
+            self.schedule(cb, call_before + cb.interval, n + 1)
+        duration = cb.duration(n)
+        self.learnDuration(cb, duration)
+        actions = cb.actions.get(n, [])
+        continued = False
+        for offset, action, other in actions:
+            self.apply(action, other, now + min(offset, duration))
+            continued = continued or (action == 'post' and other.continuation)
+        if not cb.interval and not continued:
+            self.in_pool -= 1
+        return now + duration
+
+    def run(self):
+        if not self.external:
+            return
+        now = self.external[0][0]
+        end = now + self.ticks(self.args.until_ms)
+        pending = 0
+        while now <= end:
+            while pending < len(self.external) and self.external[pending][0] <= now:
+                t, action, cb = self.external[pending]
+                self.apply(action, cb, t)
+                pending += 1
+            if self.queue and self.queue[0][0] <= now + self.tolerance(self.queue[0][2]):
+                now = self.dispatch(now)
+                continue
+            # nothing to do: sleep until the next callback is due, or the next
+            # external event wakes us up
+            next_due = self.queue[0][0] if self.queue else None
+            next_event = self.external[pending][0] if pending < len(self.external) else None
+            if next_due is None and next_event is None:
+                break
+            if next_event is not None and (next_due is None or next_event < next_due):
+                self.event_wakeups += 1
+                now = max(now, next_event)
+            else:
+                self.timer_wakeups += 1
+                now = max(now, next_due)
+
+    def report(self, out):
+        ms = lambda ticks: ticks * 1000.0 / self.time_base
+        extensions = 0
+        if self.peak_pool > self.args.initial_pool:
+            extensions = -(-(self.peak_pool - self.args.initial_pool) // self.args.pool_increment)
+        out.write('dispatches:          %d\n' % len(self.lateness))
+        out.write('wakeups:             %d (%d timer, %d external)\n' % (
+            self.timer_wakeups + self.event_wakeups, self.timer_wakeups, self.event_wakeups
+        ))
+        out.write('lateness (ms):       p50 %.3f  p90 %.3f  p99 %.3f  max %.3f\n' % tuple(
+            ms(percentile(self.lateness, p)) for p in (50, 90, 99, 100)
+        ))
+        out.write('peak queue length:   %d\n' % self.peak_queue)
+        out.write('peak pool usage:     %d (%d extension(s) of a %d + %d pool)\n' % (
+            self.peak_pool, extensions, self.args.initial_pool, self.args.pool_increment
+        ))
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.split('\n\n')[0])
+    parser.add_argument('dump', help='binary dump of minar_trace_buffer')
+    parser.add_argument('--stream', action='store_true', help='the input is a header followed by drained records')
+    parser.add_argument('--initial-pool', type=int, default=50, help='MINAR_INITIAL_EVENT_POOL_SIZE to model')
+    parser.add_argument('--pool-increment', type=int, default=100, help='MINAR_ADDITIONAL_EVENT_POOLS_SIZE to model')
+    tolerance = parser.add_mutually_exclusive_group()
+    tolerance.add_argument('--tolerance-ms', type=float, help='replace the tolerance of every callback')
+    tolerance.add_argument('--min-tolerance-ms', type=float, default=0, help='raise smaller tolerances to this')
+    parser.add_argument('--until-ms', type=float, help='how long to replay for (default: the length of the recording)')
+    policy = parser.add_mutually_exclusive_group()
+    policy.add_argument('--duration-aware', action='store_true', help='model MINAR_DURATION_AWARE')
+    policy.add_argument('--compare', action='store_true', help='replay with and without MINAR_DURATION_AWARE')
+    args = parser.parse_args()
+
+    with open(args.dump, 'rb') as f:
+        header, records = minar_trace.readTrace(f.read(), args.stream)
+    if args.until_ms is None:
+        # by default replay for as long as the recording lasted
+        ticks = minar_trace.unwrapTicks(header, records)
+        args.until_ms = (ticks[-1] * 1000.0 / header['time_base']) if ticks else 0
+
+    workload = readWorkload(header, records)
+    if args.compare:
+        policies = [('default', False), ('duration aware', True)]
+    else:
+        policies = [(None, args.duration_aware)]
+    for name, duration_aware in policies:
+        if name:
+            sys.stdout.write('%s:\n' % name)
+        sim = Simulation(workload, args, header['time_base'], duration_aware)
+        sim.run()
+        sim.report(sys.stdout)
+    return 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())
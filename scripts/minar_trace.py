@@ -0,0 +1,142 @@
+#!/usr/bin/env python
+#
+# PackageLicenseDeclared: Apache-2.0
+# Copyright (c) 2015 ARM Limited
+#
+# Licensed under the Apache License, Version 2.0 (the "License");
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#
+#     http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+
+"""Convert a dump of minar's binary trace buffer (minar_trace_buffer, see
+minar/trace_buffer.h) into Chrome trace event JSON, which can be loaded into
+chrome://tracing or https://ui.perfetto.dev.
+
+usage: minar_trace.py trace.bin [-o trace.json] [--stream]
+"""
+
+import argparse
+import json
+import struct
+import sys
+
+TRACE_MAGIC = 0x52544e4d
+HEADER_FORMAT = 'IHHIIII'
+RECORD_FORMAT = 'IB3xII'
+
+POST, CANCEL, DISPATCH_START, DISPATCH_END, SLEEP, WAKE, POOL_ALLOC, POOL_FREE, POST_PARAMS = range(1, 10)
+
+
+def readTrace(data, stream=False):
+    ''' Parse a dump of the trace buffer, returning (header, records), with the
+        records oldest first. Each record is (time, type, a, b).
+
+        If stream is True, data is a header followed by records that were
+        drained from the buffer, in order, rather than a dump of the buffer.
+    '''
+    for endian in ('<', '>'):
+        header_size = struct.calcsize(endian + HEADER_FORMAT)
+        fields = struct.unpack_from(endian + HEADER_FORMAT, data)
+        if fields[0] == TRACE_MAGIC:
+            break
+    else:
+        raise ValueError('not a minar trace buffer (bad magic)')
+    header = dict(zip(
+        ('magic', 'version', 'record_size', 'time_base', 'time_mask', 'capacity', 'written'),
+        fields
+    ))
+    if header['record_size'] != struct.calcsize(endian + RECORD_FORMAT):
+        raise ValueError('unsupported record size %d' % header['record_size'])
+
+    def recordAt(i):
+        return struct.unpack_from(endian + RECORD_FORMAT, data, header_size + i * header['record_size'])
+
+    capacity, written = header['capacity'], header['written']
+    if stream:
+        indices = range((len(data) - header_size) // header['record_size'])
+    elif written <= capacity:
+        indices = range(written)
+    else:
+        # the buffer has wrapped: the oldest record is the next to be written
+        first = written % capacity
+        indices = list(range(first, capacity)) + list(range(first))
+    return header, [recordAt(i) for i in indices]
+
+
+def unwrapTicks(header, records):
+    ''' Convert the (wrapping) tick times of the records into ticks since the
+        first record.
+    '''
+    mask = header['time_mask']
+    total = 0
+    last = None
+    result = []
+    for r in records:
+        if last is not None:
+            total += (r[0] - last) & mask
+        last = r[0]
+        result.append(total)
+    return result
+
+
+def unwrapTimes(header, records):
+    ''' Convert the (wrapping) tick times of the records into microseconds
+        since the first record.
+    '''
+    return [t * 1e6 / header['time_base'] for t in unwrapTicks(header, records)]
+
+
+def toChromeTrace(header, records):
+    events = []
+    live_nodes = 0
+
+    def event(ph, name, ts, tid, **kwargs):
+        e = {'ph': ph, 'name': name, 'ts': ts, 'pid': 1, 'tid': tid}
+        e.update(kwargs)
+        events.append(e)
+
+    for ts, (_, kind, a, b) in zip(unwrapTimes(header, records), records):
+        if kind == DISPATCH_START:
+            event('B', 'callback 0x%08x' % a, ts, 'dispatch', args={'call_before': b})
+        elif kind == DISPATCH_END:
+            event('E', 'callback 0x%08x' % a, ts, 'dispatch')
+        elif kind == SLEEP:
+            event('B', 'sleep', ts, 'dispatch', args={'until': None if b else a})
+        elif kind == WAKE:
+            event('E', 'sleep', ts, 'dispatch')
+        elif kind == POST:
+            event('i', 'post 0x%08x' % a, ts, 'queue', s='t', args={'call_before': b})
+        elif kind == CANCEL:
+            event('i', 'cancel 0x%08x' % a, ts, 'queue', s='t', args={'cancelled': bool(b)})
+        elif kind in (POOL_ALLOC, POOL_FREE):
+            live_nodes += 1 if kind == POOL_ALLOC else -1
+            event('C', 'pool', ts, 'pool', args={'nodes in use': live_nodes})
+    return {'traceEvents': events, 'displayTimeUnit': 'ms'}
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.split('\n\n')[0])
+    parser.add_argument('dump', help='binary dump of minar_trace_buffer')
+    parser.add_argument('-o', '--output', help='output file (default: stdout)')
+    parser.add_argument('--stream', action='store_true', help='the input is a header followed by drained records')
+    args = parser.parse_args()
+
+    with open(args.dump, 'rb') as f:
+        header, records = readTrace(f.read(), args.stream)
+
+    out = open(args.output, 'w') if args.output else sys.stdout
+    json.dump(toChromeTrace(header, records), out, indent=1)
+    if args.output:
+        out.close()
+    return 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())
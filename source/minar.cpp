@@ -28,6 +28,26 @@
 #include "minar-internal-headers/CallbackNode.h"
 #include "minar/trace.h"
 
+/**
+ * Wake-up calibration: measure how late the platform wakes up from timed
+ * sleeps, and end sleeps early by that much so that callbacks with tight
+ * tolerances are not dispatched late. If the next callback is due sooner than
+ * that (plus MINAR_WAKE_SPIN_TICKS), the scheduler waits without sleeping
+ * instead.
+ */
+#ifndef YOTTA_CFG_MINAR_WAKE_CALIBRATION
+#define YOTTA_CFG_MINAR_WAKE_CALIBRATION 0
+#endif
+#ifndef YOTTA_CFG_MINAR_WAKE_SPIN_TICKS
+#define YOTTA_CFG_MINAR_WAKE_SPIN_TICKS 0
+#endif
+
+/// Measure how long the dispatch loop disables interrupts for (see
+/// minar::MaskStats).
+#ifndef YOTTA_CFG_MINAR_MEASURE_MASKED_TIME
+#define YOTTA_CFG_MINAR_MEASURE_MASKED_TIME 0
+#endif
+
 using mbed::util::CriticalSectionLock;
 using mbed::util::BinaryHeap;
 using mbed::util::MinCompare;
@@ -51,6 +71,52 @@ struct YTScopeTimer{
     const void* const ptr;
 };
 
+#if YOTTA_CFG_MINAR_WAKE_CALIBRATION || YOTTA_CFG_MINAR_MEASURE_MASKED_TIME
+static unsigned histogramBucket(minar::tick_t ticks, unsigned buckets);
+#endif
+
+#if YOTTA_CFG_MINAR_MEASURE_MASKED_TIME
+// Measures the time from its construction to its destruction, minus any time
+// between pause() and resume(), and adds it to the statistics for an
+// operation. Construct it just after taking a CriticalSectionLock.
+struct MaskTimer{
+    MaskTimer(minar::MaskStats& stats, minar::MaskStats::Operation op)
+        : stats(stats), op(op), masked(0), from(minar::platform::getTime()){
+    }
+    ~MaskTimer(){
+        pause();
+        if(masked > stats.longest[op])
+            stats.longest[op] = masked;
+        stats.histogram[op][histogramBucket(masked, minar::MaskStats::Histogram_Buckets)]++;
+    }
+    void setOperation(minar::MaskStats::Operation o){
+        op = o;
+    }
+    void pause(){
+        masked += minar::platform::Time_Mask & (minar::platform::getTime() - from);
+    }
+    void resume(){
+        from = minar::platform::getTime();
+    }
+
+    minar::MaskStats& stats;
+    minar::MaskStats::Operation op;
+    minar::tick_t masked;
+    minar::tick_t from;
+};
+#else
+struct MaskTimer{
+    MaskTimer(minar::MaskStats&, minar::MaskStats::Operation){
+    }
+    void setOperation(minar::MaskStats::Operation){
+    }
+    void pause(){
+    }
+    void resume(){
+    }
+};
+#endif
+
 
 class SchedulerData{
     public:
@@ -66,20 +132,48 @@ class SchedulerData{
         };
         typedef BinaryHeap<CallbackNode*, CallbackNodeCompare> dispatch_tree_t;
 
-        SchedulerData();
+        SchedulerData(bool persistent);
+        ~SchedulerData();
 
         minar::callback_handle_t postGeneric(
                // [FPTR] cb below used to be a move ref, is there a better alternative to copy?
                minar::callback_t cb,
                minar::tick_t at,
                minar::tick_t interval,
-               minar::tick_t double_sided_tolerance
+               minar::tick_t double_sided_tolerance,
+               minar::PayloadHeader* payload = NULL
+        );
+
+        minar::callback_handle_t postContinuation(
+               minar::callback_t cb,
+               minar::tick_t at,
+               minar::tick_t interval,
+               minar::tick_t double_sided_tolerance,
+               minar::PayloadHeader* payload = NULL
         );
 
         int cancel(callback_handle_t callback);
 
+        // create a node for a callback that waits for other callbacks
+        // instead of being inserted in the dispatch tree
+        CallbackNode* createSuccessor(minar::callback_t cb);
+
+        // create a join, which waits for 'predecessors' callbacks
+        CallbackNode* createJoin(minar::callback_t cb, uint16_t predecessors);
+
+        // make 'successor' wait for 'node' to complete
+        void chain(CallbackNode* node, CallbackNode* successor);
+
+        // 'node' has completed (or been cancelled): release its successor,
+        // queuing it on the ready list if it is not waiting for anything else
+        void complete(CallbackNode* node, bool cancelled);
+
         int start();
 
+        // sleep (with interrupts disabled) until 'until', compensating for the
+        // wake-up latency if calibration is enabled
+        void sleepUntil(minar::tick_t now, minar::tick_t until);
+
         // The dispatch queue is sorted by the latest possible evaluation time
         // of each callback (i.e. callbacks later in the queue may be possible
         // to evaluate sooner than those earlier)
@@ -88,17 +182,61 @@ class SchedulerData{
         minar::tick_t last_dispatch;
         minar::tick_t current_dispatch;
         bool stop_dispatch;
+
+        // The node whose callback is currently executing (NULL outside of
+        // callbacks), and the continuation (if any) that will be stored in
+        // it when the callback returns
+        CallbackNode* dispatching;
+        bool dispatching_cancelled;
+        minar::callback_t continuation_cb;
+        minar::tick_t continuation_call_before;
+        minar::tick_t continuation_tolerance;
+        minar::PayloadHeader* continuation_payload;
+        bool continuation_pending;
+
+        // Successors that are ready to be dispatched, in the order they
+        // became ready. These are dispatched before anything in the dispatch
+        // tree.
+        CallbackNode* ready_head;
+        CallbackNode* ready_tail;
+
+        // Joins that nothing has been chained before yet, which are the only
+        // ones that can be cancelled (linked through next_ready)
+        CallbackNode* unchained_joins;
+
+        // remove 'join' from unchained_joins (with interrupts disabled),
+        // returning false if it isn't there
+        bool unlinkJoin(CallbackNode* join);
+
+        // wake-up calibration: the latency estimate is kept with 3 extra bits
+        // of precision for the moving average
+        minar::WakeStats wake_stats;
+        minar::tick_t wake_latency_x8;
+        // set while the dispatch loop is spinning, waiting for a callback
+        // that is due too soon to sleep, so that each wait counts as one spin
+        bool spinning;
+
+        minar::MaskStats mask_stats;
 };
 
 /// - Private Function Declarations
 static minar::tick_t wrapTime(minar::tick_t time);
+static minar::tick_t defaultTolerance();
 static minar::tick_t smallestTimeIncrement(minar::tick_t from, minar::tick_t to_a, minar::tick_t or_b);
 static void* addressForFunction(minar::callback_t fn);
 static bool timeIsInPeriod(minar::tick_t start, minar::tick_t time, minar::tick_t end);
+#if YOTTA_CFG_MINAR_DURATION_AWARE
+static bool startsBefore(minar::tick_t now, minar::tick_t duration, minar::tick_t deadline);
+#endif
+static void initPlatform();
 
 /// - Pointer to instance
 static minar::Scheduler* staticScheduler = NULL;
 
+/// - The scheduler whose run() is executing (the innermost one, if run() is
+///   called from a callback of another scheduler), or NULL
+static minar::Scheduler* runningScheduler = NULL;
+
 } // namespace minar
 
 
@@ -125,15 +263,54 @@ minar::Scheduler::CallbackAdder& minar::Scheduler::CallbackAdder::period(
     return *this;
 }
 
+minar::Scheduler::CallbackAdder& minar::Scheduler::CallbackAdder::then(
+    minar::callback_t const& cb
+){
+    return then(m_sched.data->createSuccessor(cb));
+}
+
+minar::Scheduler::CallbackAdder& minar::Scheduler::CallbackAdder::then(
+    minar::callback_handle_t join
+){
+    CORE_UTIL_ASSERT(!m_posted);//, "then() called after getHandle().");
+    if(m_posted){
+        // too late to chain anything after the posted callback
+        discard(join);
+        return *this;
+    }
+    if(m_chain_tail)
+        m_sched.data->chain((CallbackNode*)m_chain_tail, (CallbackNode*)join);
+    else
+        m_chain_head = join;
+    m_chain_tail = join;
+    return *this;
+}
+
 minar::callback_handle_t minar::Scheduler::CallbackAdder::getHandle(){
     if(m_cb && !m_posted){
-        minar::callback_handle_t temp = m_sched.data->postGeneric(
-            // [FPTR] std::move was used below, is there a better way to do this?
-            m_cb,
-            minar::platform::getTime() + m_delay,
-            m_period,
-            m_tolerance
-        );
+        minar::callback_handle_t temp;
+        // a continuation re-uses the node of a callback that has just
+        // completed, which can't also be the start of a new chain
+        if(m_continuation && !m_chain_head){
+            temp = m_sched.data->postContinuation(
+                m_cb,
+                minar::platform::getTime() + m_delay,
+                m_period,
+                m_tolerance,
+                m_payload
+            );
+        } else {
+            temp = m_sched.data->postGeneric(
+                // [FPTR] std::move was used below, is there a better way to do this?
+                m_cb,
+                minar::platform::getTime() + m_delay,
+                m_period,
+                m_tolerance,
+                m_payload
+            );
+        }
+        if(m_chain_head)
+            m_sched.data->chain((CallbackNode*)temp, (CallbackNode*)m_chain_head);
         m_posted = true;
         return temp;
     }
@@ -142,80 +319,222 @@ minar::callback_handle_t minar::Scheduler::CallbackAdder::getHandle(){
 
 minar::Scheduler::CallbackAdder::~CallbackAdder(){
     getHandle();
+    if(!m_posted && m_chain_head){
+        // nothing was posted: discard the chain
+        discard(m_chain_head);
+    }
+    if(!m_posted && m_payload){
+        releasePayload(m_payload);
+    }
+}
+
+void minar::Scheduler::CallbackAdder::discard(minar::callback_handle_t head){
+    // the head of the chain may be a join that is also waiting for other
+    // callbacks, so it can't just be deleted
+    CallbackNode node;
+    m_sched.data->chain(&node, (CallbackNode*)head);
+    m_sched.data->complete(&node, true);
 }
 
 minar::Scheduler::CallbackAdder::CallbackAdder(Scheduler& sched, callback_t cb)
     : m_sched(sched),
       m_cb(cb),
-      m_tolerance(minar::milliseconds(50)),
-      m_delay(minar::milliseconds(0)),
-      m_period(minar::milliseconds(0)),
-      m_posted(false){
+      m_tolerance(defaultTolerance()),
+      m_delay(0),
+      m_period(0),
+      m_posted(false),
+      m_continuation(false),
+      m_chain_head(NULL),
+      m_chain_tail(NULL),
+      m_payload(NULL){
+}
+
+minar::Scheduler::CallbackAdder::CallbackAdder(
+    Scheduler& sched, callback_t cb, bool continuation, PayloadHeader* payload
+) : m_sched(sched),
+    m_cb(cb),
+    m_tolerance(defaultTolerance()),
+    m_delay(0),
+    m_period(0),
+    m_posted(false),
+    m_continuation(continuation),
+    m_chain_head(NULL),
+    m_chain_tail(NULL),
+    m_payload(payload){
 }
 
 minar::Scheduler* minar::Scheduler::instance(){
     if(!staticScheduler){
-        staticScheduler = new minar::Scheduler();
-
-        minar::platform::init();
-
-        CORE_UTIL_ASSERT(staticScheduler->data->dispatch_tree.get_num_elements() == 0 && "State not clean: cannot init.");
-
-        staticScheduler->data->last_dispatch = minar::platform::getTime();
-        staticScheduler->data->current_dispatch = staticScheduler->data->last_dispatch;
+        staticScheduler = new minar::Scheduler(true);
+        CallbackNode::reserve(YOTTA_CFG_MINAR_PREWARM_EVENT_POOL_SIZE);
     }
     return staticScheduler;
 }
 
 minar::Scheduler::Scheduler()
+    : data(NULL){
+    init(false);
+}
+
+minar::Scheduler::Scheduler(bool persistent)
+    : data(NULL){
+    init(persistent);
+}
+
+minar::Scheduler::~Scheduler(){
+    delete data;
+}
+
+void minar::Scheduler::init(bool persistent){
     // !!! FIXME: make_unique is C++14
-    //: data(std::make_unique<minar::SchedulerData>()){
-    : data(new minar::SchedulerData()){
+    //data = std::make_unique<minar::SchedulerData>();
+    data = new minar::SchedulerData(persistent);
+
+    initPlatform();
+
+    data->last_dispatch = minar::platform::getTime();
+    data->current_dispatch = data->last_dispatch;
+}
+
+int minar::Scheduler::run(){
+    minar::Scheduler* const outer = runningScheduler;
+    runningScheduler = this;
+    const int remaining = data->start();
+    runningScheduler = outer;
+    return remaining;
+}
+
+int minar::Scheduler::halt(){
+    data->stop_dispatch = true;
+    return data->dispatch_tree.get_num_elements();
+}
+
+minar::Scheduler::CallbackAdder minar::Scheduler::post(
+    minar::callback_t const& cb
+){
+    return CallbackAdder(*this, cb);
+}
+
+minar::Scheduler::CallbackAdder minar::Scheduler::continuation(
+    minar::callback_t const& cb
+){
+    return CallbackAdder(*this, cb, true, NULL);
+}
+
+minar::callback_handle_t minar::Scheduler::join(minar::callback_t const& cb, uint16_t predecessors){
+    return data->createJoin(cb, predecessors);
+}
+
+int minar::Scheduler::cancel(minar::callback_handle_t handle){
+    return data->cancel(handle);
+}
+
+minar::tick_t minar::Scheduler::time() const{
+    return data->current_dispatch;
+}
+
+minar::WakeStats minar::Scheduler::wakeStats() const{
+    CriticalSectionLock lock;
+    return data->wake_stats;
+}
+
+minar::MaskStats minar::Scheduler::maskStats() const{
+    CriticalSectionLock lock;
+    return data->mask_stats;
 }
 
 int minar::Scheduler::start(){
-    instance();
-    return staticScheduler->data->start();
+    return instance()->run();
 }
 
 int minar::Scheduler::stop(){
-    instance();
-    staticScheduler->data->stop_dispatch = true;
-    return staticScheduler->data->dispatch_tree.get_num_elements();
+    return instance()->halt();
 }
 
 minar::Scheduler::CallbackAdder minar::Scheduler::postCallback(
     minar::callback_t const& cb
 ){
-    instance();
-    return CallbackAdder(*staticScheduler, cb);
+    return instance()->post(cb);
+}
+
+minar::Scheduler::CallbackAdder minar::Scheduler::postContinuation(
+    minar::callback_t const& cb
+){
+    // the node that can be re-used belongs to the scheduler that is running
+    return (runningScheduler? runningScheduler : instance())->continuation(cb);
+}
+
+minar::callback_handle_t minar::Scheduler::postJoin(minar::callback_t const& cb, uint16_t predecessors){
+    return instance()->join(cb, predecessors);
 }
 
 int minar::Scheduler::cancelCallback(minar::callback_handle_t handle){
-    instance();
-    return staticScheduler->data->cancel(handle);
+    return instance()->cancel(handle);
+}
+
+minar::PoolStats minar::Scheduler::getPoolStats(){
+    CriticalSectionLock lock;
+    return CallbackNode::get_pool_state().stats;
 }
 
 minar::tick_t minar::Scheduler::getTime() {
-    instance();
-    return staticScheduler->data->current_dispatch;
+    return (runningScheduler? runningScheduler : instance())->time();
 }
 
 /// - SchedulerData Implementation
 
-minar::SchedulerData::SchedulerData()
+minar::SchedulerData::SchedulerData(bool persistent)
   : dispatch_tree(CallbackNodeCompare(*this)),
     last_dispatch(0),
     current_dispatch(0),
-    stop_dispatch(false){
+    stop_dispatch(false),
+    dispatching(NULL),
+    dispatching_cancelled(false),
+    continuation_cb(),
+    continuation_call_before(0),
+    continuation_tolerance(0),
+    continuation_payload(NULL),
+    continuation_pending(false),
+    ready_head(NULL),
+    ready_tail(NULL),
+    unchained_joins(NULL),
+    wake_stats(),
+    wake_latency_x8(0),
+    spinning(false),
+    mask_stats(){
     UAllocTraits_t traits;
 
-    traits.flags = UALLOC_TRAITS_NEVER_FREE;
+    // the default scheduler lives for the lifetime of the program, so its
+    // queue goes in the never-free heap; other instances can be destroyed
+    traits.flags = persistent? UALLOC_TRAITS_NEVER_FREE : 0;
     if (!dispatch_tree.init(YOTTA_CFG_MINAR_INITIAL_EVENT_POOL_SIZE, YOTTA_CFG_MINAR_ADDITIONAL_EVENT_POOLS_SIZE, traits)) {
         CORE_UTIL_RUNTIME_ERROR("Unable to initialize binary heap for SchedulerData");
     }
 }
 
+minar::SchedulerData::~SchedulerData(){
+    // release anything that was never dispatched (or is periodic), and
+    // anything chained after it
+    while(dispatch_tree.get_num_elements() > 0){
+        CallbackNode *node = dispatch_tree.get_root();
+        dispatch_tree.remove_root();
+        complete(node, true);
+        delete node;
+    }
+    while(unchained_joins){
+        CallbackNode *node = unchained_joins;
+        unchained_joins = node->next_ready;
+        complete(node, true);
+        delete node;
+    }
+    while(ready_head){
+        CallbackNode *node = ready_head;
+        ready_head = node->next_ready;
+        complete(node, true);
+        delete node;
+    }
+}
+
 bool minar::SchedulerData::CallbackNodeCompare::operator ()(const heap_node_t &a, const heap_node_t &b) const {
     // FIXME!!!! double-check that this works for the case where multiple
     // callbacks have the same dispatch time, and we pop one, set Dispatch equal
@@ -236,6 +555,7 @@ int minar::SchedulerData::start(){
     minar::tick_t now = 0;
     minar::tick_t now_plus_tolerance = 0;
     bool something_to_do = false;
+    bool pool_maintenance = false;
 
     while(!stop_dispatch){
         now = minar::platform::getTime();
@@ -247,9 +567,21 @@ int minar::SchedulerData::start(){
         something_to_do = false;
         {
             CriticalSectionLock lock;
+            MaskTimer masked(mask_stats, MaskStats::Mask_Sleep);
             CallbackNode *best = NULL;
 
-            if(dispatch_tree.get_num_elements() > 0) {
+            if(ready_head != NULL) {
+                masked.setOperation(MaskStats::Mask_Ready);
+                // successors of callbacks that have completed are due
+                // immediately, and aren't in the dispatch tree at all
+                next = ready_head;
+                ready_head = next->next_ready;
+                if(ready_head == NULL)
+                    ready_tail = NULL;
+                next->next_ready = NULL;
+                something_to_do = true;
+            }
+            else if(dispatch_tree.get_num_elements() > 0) {
                 CallbackNode *root = dispatch_tree.get_root();
                 now_plus_tolerance = wrapTime(now + root->tolerance);
                 if (timeIsInPeriod(last_dispatch, root->call_before, now_plus_tolerance)) {
@@ -257,6 +589,7 @@ int minar::SchedulerData::start(){
                 }
             }
             if (best != NULL) {
+                masked.setOperation(MaskStats::Mask_Pop);
                 next = best;
                 dispatch_tree.remove_root();
                 something_to_do = true;
@@ -279,8 +612,38 @@ int minar::SchedulerData::start(){
                 const minar::tick_t lag = wrapTime(now - last_dispatch);
                 if(lag > Warn_Lag_Ticks)
                     ytWarning("WARNING: event loop lag %lums\n", lag / minar::milliseconds(1));
+
+#if YOTTA_CFG_MINAR_DURATION_AWARE
+                // If executing 'next' now would make the callback after it
+                // late, and that one is also due and short enough to execute
+                // first without making 'next' late, swap them. (last_dispatch
+                // has been updated for 'next', which is still the earliest
+                // deadline, so the tree stays sorted. This stays in the masked
+                // section of the pop, so that 'next' can still be cancelled
+                // from an interrupt handler: see MaskStats for the bound.)
+                if(dispatch_tree.get_num_elements() > 0) {
+                    CallbackNode *other = dispatch_tree.get_root();
+                    // a callback that hasn't run yet (which includes every
+                    // one-shot callback) can't be assumed to be short
+                    if (other->hasDurationSample() &&
+                        timeIsInPeriod(last_dispatch, other->call_before, wrapTime(now + other->tolerance)) &&
+                        startsBefore(now, 0, other->call_before) &&
+                        !startsBefore(now, next->estimatedDuration(), other->call_before) &&
+                        startsBefore(now, other->estimatedDuration(), next->call_before)) {
+                        dispatch_tree.remove_root();
+                        dispatch_tree.insert(next);
+                        next = other;
+                    }
+                }
+#endif
+            }
+            else if (!something_to_do && CallbackNode::idle())
+            {
+                // nothing to do, but the pool should grow before we next
+                // need it: do that with interrupts enabled, then come back
+                pool_maintenance = true;
             }
-            else
+            else if (!something_to_do)
             {
                 // nothing we can do right now... so go to sleep
                 ytTraceDispatch("-_-\n");
@@ -308,10 +671,19 @@ int minar::SchedulerData::start(){
                 if (dispatch_tree.get_num_elements() > 0) {
                     CallbackNode *root = dispatch_tree.get_root();
                     last_dispatch = smallestTimeIncrement(last_dispatch, now, root->call_before);
-                    minar::platform::sleepFromUntil(now, root->call_before);
+                    masked.pause();
+                    sleepUntil(now, root->call_before);
+                    masked.resume();
                 } else {
                     last_dispatch = now;
+#if YOTTA_CFG_MINAR_WAKE_CALIBRATION
+                    spinning = false;
+#endif
+                    ytTraceRecord(trace::Trace_Sleep, 0, 1);
+                    masked.pause();
                     minar::platform::sleep();
+                    ytTraceRecord(trace::Trace_Wake, 0, 0);
+                    masked.resume();
                 }
 
                 // before taking re-enabling interrupts (and taking any
@@ -325,10 +697,19 @@ int minar::SchedulerData::start(){
             // then return here
         }
 
+        if(pool_maintenance){
+            CallbackNode::maintain();
+            pool_maintenance = false;
+        }
+
         // this is skipped when we return from sleep
         // because something_to_do will be false
         if(something_to_do){
             // therefore "next" is valid
+#if YOTTA_CFG_MINAR_WAKE_CALIBRATION
+            // whatever we were waiting for (if anything) has arrived
+            spinning = false;
+#endif
             ytTraceDispatch("[picked first, ahead / %d]\r\n", dispatch_tree.get_num_elements());
 
             // current_dispatch is provided through the ytGetTime API call so
@@ -340,37 +721,132 @@ int minar::SchedulerData::start(){
             // compared to last_dispatch
             current_dispatch = wrapTime(next->call_before - next->tolerance/2);
 
+            // recorded before a periodic callback is re-armed, so that this
+            // is the deadline being dispatched
+            ytTraceRecord(trace::Trace_Dispatch_Start, ytTracePtr(next), next->call_before);
+
             if(next->interval){
                 // recycle the callback for next time: do that here so that the
                 // callback can cancel itself
                 next->call_before = wrapTime(next->call_before + next->interval);
+                // the dispatch tree disables interrupts while it is modified: do
+                // that here, so that only the masked time is measured, and the
+                // statistics are updated with interrupts disabled
+                CriticalSectionLock lock;
+                MaskTimer masked(mask_stats, MaskStats::Mask_Insert);
                 dispatch_tree.insert(next);
             }
 
             // dispatch!
+            dispatching = next;
             if(next->cb){
                 ytTraceDispatch("[dispatch: now=%lx func=%p]\r\n", now, addressForFunction(next->cb));
                 YTScopeTimer t(Warn_Duration_Ticks, "callback", addressForFunction(next->cb));
+#if YOTTA_CFG_MINAR_DURATION_AWARE
+                const minar::tick_t started = minar::platform::getTime();
+                next->cb();
+                next->addDurationSample(wrapTime(minar::platform::getTime() - started));
+#else
                 next->cb();
+#endif
             }
-
-            if(!next->interval){
-                // release any reference-counted callback as early as possible
+            ytTraceRecord(trace::Trace_Dispatch_End, ytTracePtr(next), 0);
+            dispatching = NULL;
+
+            if(dispatching_cancelled){
+                // a periodic callback cancelled itself: it could only be
+                // freed once it had returned
+                dispatching_cancelled = false;
+                complete(next, true);
                 delete next;
                 next = NULL;
             }
+            else if(!next->interval){
+                complete(next, false);
+                if(continuation_pending){
+                    // the callback posted its successor: re-use this node
+                    // for it instead of freeing it and allocating another
+                    next->cb          = continuation_cb;
+                    next->call_before = continuation_call_before;
+                    next->tolerance   = continuation_tolerance;
+                    // the payload of the callback that has completed isn't
+                    // needed any more
+                    if(next->payload)
+                        releasePayload(next->payload);
+                    next->payload     = continuation_payload;
+                    continuation_payload = NULL;
+#if YOTTA_CFG_MINAR_DURATION_AWARE
+                    next->duration_x8 = 0;
+#endif
+                    continuation_cb   = minar::callback_t();
+                    continuation_pending = false;
+                    // the dispatch tree disables interrupts while it is modified: do
+                    // that here, so that only the masked time is measured, and the
+                    // statistics are updated with interrupts disabled
+                    CriticalSectionLock lock;
+                    MaskTimer masked(mask_stats, MaskStats::Mask_Insert);
+                    dispatch_tree.insert(next);
+                } else {
+                    // release any reference-counted callback as early as possible
+                    delete next;
+                }
+                next = NULL;
+            }
         }
     } // loop while(!stop_dispatch)
 
     return dispatch_tree.get_num_elements();
 }
 
+void minar::SchedulerData::sleepUntil(minar::tick_t now, minar::tick_t until){
+#if YOTTA_CFG_MINAR_WAKE_CALIBRATION
+    const minar::tick_t latency = wake_latency_x8 / 8;
+
+    // too close to sleep: return without sleeping, and the dispatch loop will
+    // check again
+    if(wrapTime(until - now) <= latency + YOTTA_CFG_MINAR_WAKE_SPIN_TICKS){
+        if(!spinning)
+            wake_stats.spins++;
+        spinning = true;
+        return;
+    }
+    spinning = false;
+
+    const minar::tick_t target = wrapTime(until - latency);
+    ytTraceRecord(trace::Trace_Sleep, target, 0);
+    minar::platform::sleepFromUntil(now, target);
+    const minar::tick_t woke = minar::platform::getTime();
+    ytTraceRecord(trace::Trace_Wake, 0, 0);
+
+    // if we woke before the target time it was because of an interrupt, which
+    // tells us nothing about the latency
+    const minar::tick_t late = wrapTime(woke - target);
+    if(late < minar::platform::Time_Mask/2){
+        // moving average with a weight of 1/8 for each new sample
+        wake_latency_x8 = wake_latency_x8 - wake_latency_x8/8 + late;
+        wake_stats.latency = wake_latency_x8 / 8;
+        wake_stats.samples++;
+
+        const minar::tick_t error = wrapTime(woke - until);
+        // wake-ups before 'until' count as on time
+        wake_stats.histogram[
+            (error < minar::platform::Time_Mask/2)? histogramBucket(error, WakeStats::Histogram_Buckets) : 0
+        ]++;
+    }
+#else
+    ytTraceRecord(trace::Trace_Sleep, until, 0);
+    minar::platform::sleepFromUntil(now, until);
+    ytTraceRecord(trace::Trace_Wake, 0, 0);
+#endif
+}
+
 minar::callback_handle_t minar::SchedulerData::postGeneric(
        // [FPTR] cb below used to be a move ref, is there a better alternative to copy?
        minar::callback_t cb,
            minar::tick_t at,
            minar::tick_t interval,
-           minar::tick_t double_sided_tolerance
+           minar::tick_t double_sided_tolerance,
+       minar::PayloadHeader* payload
 ){
     CORE_UTIL_ASSERT(double_sided_tolerance < (minar::platform::Time_Mask/2) + 1);//, "Callback tolerance greater than time wrap-around.");
 
@@ -382,16 +858,165 @@ minar::callback_handle_t minar::SchedulerData::postGeneric(
         2 * double_sided_tolerance,
         interval
     );
+    n->payload = payload;
     dispatch_tree.insert(n);
+    ytTraceRecord(trace::Trace_Post, ytTracePtr(n), n->call_before);
+    ytTraceRecord(trace::Trace_Post_Params, interval, n->tolerance);
     return n;
 }
 
+minar::callback_handle_t minar::SchedulerData::postContinuation(
+       minar::callback_t cb,
+           minar::tick_t at,
+           minar::tick_t interval,
+           minar::tick_t double_sided_tolerance,
+       minar::PayloadHeader* payload
+){
+    // only one-shot callbacks can hand their node on, and only once
+    if(dispatching == NULL || dispatching->interval || interval || continuation_pending)
+        return postGeneric(cb, at, interval, double_sided_tolerance, payload);
+
+    CORE_UTIL_ASSERT(double_sided_tolerance < (minar::platform::Time_Mask/2) + 1);//, "Callback tolerance greater than time wrap-around.");
+
+    ytTraceDispatch("[continue %lx %lx %p]\n", minar::platform::getTime(), at, addressForFunction(cb));
+
+    continuation_cb          = cb;
+    continuation_call_before = wrapTime(at);
+    continuation_tolerance   = 2 * double_sided_tolerance;
+    continuation_payload     = payload;
+    continuation_pending     = true;
+    ytTraceRecord(trace::Trace_Post, ytTracePtr(dispatching), continuation_call_before);
+    ytTraceRecord(trace::Trace_Post_Params, 0, continuation_tolerance);
+    return dispatching;
+}
+
+minar::CallbackNode* minar::SchedulerData::createSuccessor(minar::callback_t cb){
+    return new CallbackNode(cb, 0, 0, 0);
+}
+
+minar::CallbackNode* minar::SchedulerData::createJoin(minar::callback_t cb, uint16_t predecessors){
+    CORE_UTIL_ASSERT(predecessors > 0);//, "A join must wait for something.");
+    CallbackNode* join = new CallbackNode(cb, 0, 0, 0);
+    // the join counts its predecessors from the start, so that it can't be
+    // dispatched (and freed) while it is still being chained after others
+    join->waiting_for = predecessors;
+    join->join = true;
+    join->unchained = true;
+    CriticalSectionLock lock;
+    join->next_ready = unchained_joins;
+    unchained_joins = join;
+    return join;
+}
+
+bool minar::SchedulerData::unlinkJoin(CallbackNode* join){
+    // a linear search, but only through joins that haven't been chained yet
+    CriticalSectionLock lock;
+    for(CallbackNode** link = &unchained_joins; *link != NULL; link = &(*link)->next_ready){
+        if(*link == join){
+            *link = join->next_ready;
+            join->next_ready = NULL;
+            join->unchained = false;
+            return true;
+        }
+    }
+    return false;
+}
+
+void minar::SchedulerData::chain(CallbackNode* node, CallbackNode* successor){
+    CriticalSectionLock lock;
+    CORE_UTIL_ASSERT(node->successor == NULL);//, "Callback already has a successor.");
+    node->successor = successor;
+    if(!successor->join)
+        successor->waiting_for++;
+    else if(successor->unchained)
+        unlinkJoin(successor);
+}
+
+void minar::SchedulerData::complete(CallbackNode* node, bool cancelled){
+    // callbacks can be cancelled from interrupt handlers, so the chain is
+    // modified with interrupts disabled: one callback at a time, so that
+    // discarding a long chain doesn't keep them disabled for long
+    CallbackNode* successor;
+    {
+        CriticalSectionLock lock;
+        successor = node->successor;
+        node->successor = NULL;
+    }
+    while(successor != NULL){
+        CallbackNode* discard;
+        {
+            CriticalSectionLock lock;
+            if(cancelled)
+                successor->abandoned = true;
+            if(--successor->waiting_for)
+                break;
+            if(!successor->abandoned){
+                // successors see the scheduled time of what they follow as
+                // the current time
+                successor->call_before = current_dispatch;
+                if(ready_tail)
+                    ready_tail->next_ready = successor;
+                else
+                    ready_head = successor;
+                ready_tail = successor;
+                ytTraceRecord(trace::Trace_Post, ytTracePtr(successor), successor->call_before);
+                ytTraceRecord(trace::Trace_Post_Params, 0, 0);
+                break;
+            }
+            // one of the callbacks this was waiting for was cancelled, so it
+            // will never run: discard it and everything after it
+            discard = successor;
+            successor = successor->successor;
+            discard->successor = NULL;
+        }
+        delete discard;
+        cancelled = true;
+    }
+}
+
 int minar::SchedulerData::cancel(minar::callback_handle_t handle) {
     CallbackNode *node = (CallbackNode*)handle;
-    if (dispatch_tree.remove(node)) {
+    if (node == dispatching && continuation_pending) {
+        // the continuation hasn't been inserted yet: just forget it
+        continuation_cb = minar::callback_t();
+        if(continuation_payload){
+            releasePayload(continuation_payload);
+            continuation_payload = NULL;
+        }
+        continuation_pending = false;
+        ytTraceRecord(trace::Trace_Cancel, ytTracePtr(node), 1);
+        return 1;
+    }
+    bool removed;
+    {
+        // the dispatch tree disables interrupts while it is modified: do
+        // that here, so that only the masked time is measured, and the
+        // statistics are updated with interrupts disabled
+        CriticalSectionLock lock;
+        MaskTimer masked(mask_stats, MaskStats::Mask_Remove);
+        removed = dispatch_tree.remove(node);
+    }
+    if (removed) {
+        ytTraceRecord(trace::Trace_Cancel, ytTracePtr(node), 1);
+        if (node == dispatching) {
+            // a periodic callback cancelling itself: the dispatch loop still
+            // needs it, and will free it when the callback returns
+            dispatching_cancelled = true;
+            return 1;
+        }
+        complete(node, true);
+        delete node;
+        return 1;
+    } else if (unlinkJoin(node)) {
+        // a join that isn't waiting for anything yet (the handle is only
+        // compared with the joins on the list, since it may already have
+        // been freed)
+        ytTraceRecord(trace::Trace_Cancel, ytTracePtr(node), 1);
+        complete(node, true);
         delete node;
         return 1;
     } else {
+        ytTraceRecord(trace::Trace_Cancel, ytTracePtr(node), 0);
         return 0;
     }
 }
@@ -421,13 +1046,19 @@ uint32_t minar::ticks(minar::platform::tick_t ticks){
 /// different to their scheduled order because of the resources they need, then
 /// this time will jump backwards.
 minar::tick_t minar::getTime(){
-    return Scheduler::instance()->getTime();
+    return Scheduler::getTime();
 }
 
 static minar::tick_t minar::wrapTime(minar::tick_t time){
     return time & minar::platform::Time_Mask;
 }
 
+static minar::tick_t minar::defaultTolerance(){
+    // 50ms: computed as a constant rather than with minar::milliseconds(),
+    // since this is done for every post
+    return (minar::tick_t)(((uint64_t)50 * (uint64_t)minar::platform::Time_Base) / 1000);
+}
+
 static minar::tick_t minar::smallestTimeIncrement(minar::tick_t from, minar::tick_t to_a, minar::tick_t or_b){
     if((to_a >= from && or_b >= from) || (to_a < from && or_b < from))
         return (to_a < or_b)? to_a : or_b;
@@ -444,6 +1075,37 @@ static void* minar::addressForFunction(minar::callback_t){
     return NULL;
 }
 
+#if YOTTA_CFG_MINAR_WAKE_CALIBRATION || YOTTA_CFG_MINAR_MEASURE_MASKED_TIME
+static unsigned minar::histogramBucket(minar::tick_t ticks, unsigned buckets){
+    // bucket 0 is for 0, bucket i for [2^(i-1), 2^i), and the last bucket
+    // for everything larger
+    unsigned bucket = 0;
+    while(ticks && bucket < buckets - 1){
+        ticks >>= 1;
+        bucket++;
+    }
+    return bucket;
+}
+#endif
+
+#if YOTTA_CFG_MINAR_DURATION_AWARE
+static bool minar::startsBefore(minar::tick_t now, minar::tick_t duration, minar::tick_t deadline){
+    // true if something started 'duration' after 'now' would start before
+    // 'deadline', which must not be in the past
+    const minar::tick_t remaining = wrapTime(deadline - now);
+    return remaining < (minar::platform::Time_Mask/2) && duration <= remaining;
+}
+#endif
+
+static void minar::initPlatform(){
+    // the platform is shared by all scheduler instances
+    static bool initialised = false;
+    if(!initialised){
+        minar::platform::init();
+        initialised = true;
+    }
+}
+
 static bool minar::timeIsInPeriod(minar::tick_t start, minar::tick_t time, minar::tick_t end){
     // Taking care to handle wrapping: (M = now + Minumum_Sleep)
     //   Case (A.1)
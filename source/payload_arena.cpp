@@ -0,0 +1,118 @@
+/*
+ * PackageLicenseDeclared: Apache-2.0
+ * Copyright (c) 2015 ARM Limited
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include "minar/minar.h"
+#include "core-util/ExtendablePoolAllocator.h"
+#include "core-util/CriticalSectionLock.h"
+#include "core-util/assert.h"
+
+/**
+ * Parameters to control the initial size and growth increments of each of the
+ * pools in the payload arena (one pool per size class, created when the first
+ * payload of that size is posted).
+ */
+#ifndef YOTTA_CFG_MINAR_PAYLOAD_POOL_SIZE
+#define YOTTA_CFG_MINAR_PAYLOAD_POOL_SIZE            4
+#endif
+#ifndef YOTTA_CFG_MINAR_ADDITIONAL_PAYLOAD_POOLS_SIZE
+#define YOTTA_CFG_MINAR_ADDITIONAL_PAYLOAD_POOLS_SIZE 4
+#endif
+
+/// - Private Types
+
+namespace minar{
+namespace{
+
+enum PayloadArenaConstants{
+    // blocks are 32, 64, 128 or 256 bytes long
+    Smallest_Size_Class_Log2 = 5,
+    Size_Classes = 4
+};
+
+} // anonymous namespace
+} // namespace minar
+
+/// - Private Function Declarations
+
+namespace minar{
+namespace{
+
+mbed::util::ExtendablePoolAllocator* getPayloadAllocator(uint8_t size_class);
+
+} // anonymous namespace
+} // namespace minar
+
+/// - Implementation of Public Functions
+
+void* minar::allocPayload(size_t size, uint8_t& size_class){
+    CORE_UTIL_ASSERT(size <= Max_Payload_Block_Size);//, "Payload too large.");
+    size_class = 0;
+    while(((size_t)1 << (Smallest_Size_Class_Log2 + size_class)) < size)
+        size_class++;
+
+    void* p = getPayloadAllocator(size_class)->alloc();
+    if(p == NULL){
+        CORE_UTIL_RUNTIME_ERROR("Unable to allocate payload block");
+    }
+    return p;
+}
+
+void minar::releasePayload(PayloadHeader* block){
+    // the block isn't valid once the payload has been destroyed
+    uint8_t size_class = block->size_class;
+    block->destroy(block);
+    getPayloadAllocator(size_class)->free(block);
+}
+
+/// - Implementation of Private Functions
+
+namespace minar{
+namespace{
+
+mbed::util::ExtendablePoolAllocator* getPayloadAllocator(uint8_t size_class){
+    static mbed::util::ExtendablePoolAllocator* allocators[Size_Classes] = {NULL};
+    CORE_UTIL_ASSERT(size_class < Size_Classes);
+
+    if(NULL == allocators[size_class]){
+        // payloads can be posted from interrupt handlers, so the allocator is
+        // created with interrupts disabled, making sure that only one is
+        // created for each size class
+        mbed::util::CriticalSectionLock lock;
+        if(NULL != allocators[size_class])
+            return allocators[size_class];
+        UAllocTraits_t traits;
+        traits.flags = UALLOC_TRAITS_NEVER_FREE; // allocate in the never-free heap
+        mbed::util::ExtendablePoolAllocator* allocator = new mbed::util::ExtendablePoolAllocator;
+        if(allocator == NULL){
+            CORE_UTIL_RUNTIME_ERROR("Unable to create allocator for payloads");
+        }
+        if(!allocator->init(
+            YOTTA_CFG_MINAR_PAYLOAD_POOL_SIZE,
+            YOTTA_CFG_MINAR_ADDITIONAL_PAYLOAD_POOLS_SIZE,
+            (size_t)1 << (Smallest_Size_Class_Log2 + size_class),
+            traits
+        )){
+            CORE_UTIL_RUNTIME_ERROR("Unable to initialize allocator for payloads");
+        }
+        allocators[size_class] = allocator;
+    }
+    return allocators[size_class];
+}
+
+} // anonymous namespace
+} // namespace minar
@@ -0,0 +1,112 @@
+/*
+ * PackageLicenseDeclared: Apache-2.0
+ * Copyright (c) 2015 ARM Limited
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "minar/trace.h"
+
+#ifdef YOTTA_CFG_MINAR_TRACE_BUFFER_SIZE
+
+#include "minar/trace_buffer.h"
+#include "minar-platform/minar_platform.h"
+#include "core-util/CriticalSectionLock.h"
+
+using mbed::util::CriticalSectionLock;
+
+/// - Private Types
+
+namespace minar{
+namespace trace{
+enum{
+    Capacity = YOTTA_CFG_MINAR_TRACE_BUFFER_SIZE,
+    Index_Mask = Capacity - 1,
+};
+// a power of two, so that the ring index is just a mask
+typedef char capacity_must_be_a_power_of_two[(Capacity > 0 && (Capacity & Index_Mask) == 0)? 1 : -1];
+
+struct Buffer{
+    Header header;
+    Record records[Capacity];
+};
+} // namespace trace
+} // namespace minar
+
+/// - Buffer (a C symbol, so it is easy to find from a debugger)
+
+extern "C" {
+minar::trace::Buffer minar_trace_buffer = {
+    {
+        minar::trace::Trace_Magic,
+        minar::trace::Trace_Version,
+        sizeof(minar::trace::Record),
+        minar::platform::Time_Base,
+        minar::platform::Time_Mask,
+        minar::trace::Capacity,
+        0
+    },
+    {}
+};
+}
+
+/// - Private Data
+
+static uint32_t read_index = 0;
+
+/// - Public Function Definitions
+
+void minar::trace::record(uint8_t type, uint32_t a, uint32_t b){
+    const uint32_t time = minar::platform::getTime();
+    // records can be written from interrupt handlers as well as from the
+    // event loop, so claiming a slot has to be atomic
+    CriticalSectionLock lock;
+    Record& r = minar_trace_buffer.records[minar_trace_buffer.header.written++ & Index_Mask];
+    r.time = time;
+    r.type = type;
+    r.a    = a;
+    r.b    = b;
+}
+
+const void* minar::trace::getBuffer(size_t* size){
+    if(size)
+        *size = sizeof(minar_trace_buffer);
+    return &minar_trace_buffer;
+}
+
+size_t minar::trace::drain(Record* out, size_t max, uint32_t* lost){
+    size_t count = 0;
+    // copy one record per critical section, so that interrupts are only
+    // masked briefly however much is drained
+    while(count < max){
+        CriticalSectionLock lock;
+        const uint32_t written = minar_trace_buffer.header.written;
+        if(written == read_index)
+            break;
+        if(written - read_index > Capacity){
+            if(lost)
+                *lost += written - read_index - Capacity;
+            read_index = written - Capacity;
+        }
+        out[count++] = minar_trace_buffer.records[read_index++ & Index_Mask];
+    }
+    return count;
+}
+
+void minar::trace::clear(){
+    CriticalSectionLock lock;
+    minar_trace_buffer.header.written = 0;
+    read_index = 0;
+}
+
+#endif // #ifdef YOTTA_CFG_MINAR_TRACE_BUFFER_SIZE
@@ -0,0 +1,118 @@
+/*
+ * PackageLicenseDeclared: Apache-2.0
+ * Copyright (c) 2015 ARM Limited
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Checks the order of execution of chained callbacks, of a join that waits
+// for two callbacks, of a join that is chained after its second callback
+// only once the first one has completed, and that cancelling the start of a
+// chain discards the rest of it. Also checks that a join that hasn't been
+// chained yet can be cancelled.
+
+#include <stdio.h>
+#include <string.h>
+#include "minar/minar.h"
+#include "mbed-drivers/mbed.h"
+#include "greentea-client/test_env.h"
+#include "unity/unity.h"
+#include "core-util/FunctionPointer.h"
+
+using mbed::util::FunctionPointer1;
+
+static char order[16];
+static unsigned num_run;
+
+static void run(char name) {
+    printf("%c\r\n", name);
+    if (num_run < sizeof(order) - 1) {
+        order[num_run++] = name;
+    }
+}
+
+static minar::callback_t step(char name) {
+    return FunctionPointer1<void, char>(run).bind(name);
+}
+
+static minar::callback_handle_t k;
+
+static void chain_late() {
+    // g has completed by now: k must still wait for h
+    minar::Scheduler::postCallback(step('h'))
+        .delay(minar::milliseconds(10))
+        .tolerance(minar::milliseconds(5))
+        .then(k);
+}
+
+static void stop_scheduler() {
+    minar::Scheduler::stop();
+}
+
+void app_start(int, char*[]) {
+    GREENTEA_SETUP(10, "default");
+
+    // a -> b -> c
+    minar::Scheduler::postCallback(step('a'))
+        .delay(minar::milliseconds(100))
+        .tolerance(minar::milliseconds(5))
+        .then(step('b'))
+        .then(step('c'));
+
+    // (d, e) -> f, where e runs a long time after d
+    minar::callback_handle_t f = minar::Scheduler::postJoin(step('f'), 2);
+    minar::Scheduler::postCallback(step('d'))
+        .delay(minar::milliseconds(200))
+        .tolerance(minar::milliseconds(5))
+        .then(f);
+    minar::Scheduler::postCallback(step('e'))
+        .delay(minar::milliseconds(400))
+        .tolerance(minar::milliseconds(5))
+        .then(f);
+
+    // x -> y, cancelled before it runs
+    minar::callback_handle_t x = minar::Scheduler::postCallback(step('x'))
+        .delay(minar::milliseconds(300))
+        .tolerance(minar::milliseconds(5))
+        .then(step('y'))
+        .getHandle();
+    minar::Scheduler::cancelCallback(x);
+
+    // (g, h) -> k, where h is only posted (and chained) after g has run
+    k = minar::Scheduler::postJoin(step('k'), 2);
+    minar::Scheduler::postCallback(step('g'))
+        .delay(minar::milliseconds(500))
+        .tolerance(minar::milliseconds(5))
+        .then(k);
+    minar::Scheduler::postCallback(chain_late)
+        .delay(minar::milliseconds(600))
+        .tolerance(minar::milliseconds(5));
+
+    // z is never chained after anything, so it can be cancelled
+    minar::callback_handle_t z = minar::Scheduler::postJoin(step('z'), 1);
+    int z_cancelled = minar::Scheduler::cancelCallback(z);
+
+    minar::Scheduler::postCallback(stop_scheduler)
+        .delay(minar::milliseconds(1000))
+        .tolerance(minar::milliseconds(10));
+
+    int cb_cnt = minar::Scheduler::start(); // returns after stop_scheduler
+
+    printf("Order: %s\r\n", order);
+    bool order_ok = strcmp(order, "abcdefghk") == 0;
+    TEST_ASSERT_TRUE_MESSAGE(order_ok, "Callbacks ran in the wrong order");
+    TEST_ASSERT_EQUAL_MESSAGE(1, z_cancelled, "Unchained join could not be cancelled");
+    TEST_ASSERT_EQUAL_MESSAGE(0, cb_cnt, "Wrong call back count!");
+
+    GREENTEA_TESTSUITE_RESULT(order_ok && (z_cancelled == 1) && (cb_cnt == 0));
+}
@@ -0,0 +1,72 @@
+/*
+ * PackageLicenseDeclared: Apache-2.0
+ * Copyright (c) 2015 ARM Limited
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Runs a sequence of steps, each one posting the next with
+// postContinuation, and checks that they all run in order and that the
+// handle of every step is the node of the first one (i.e. no new nodes were
+// allocated for the sequence).
+
+#include <stdio.h>
+#include "minar/minar.h"
+#include "mbed-drivers/mbed.h"
+#include "greentea-client/test_env.h"
+#include "unity/unity.h"
+#include "core-util/FunctionPointer.h"
+
+using mbed::util::FunctionPointer1;
+
+#define NUM_STEPS 10
+
+static int steps;
+static bool handles_ok = true;
+static minar::callback_handle_t first_handle;
+
+static void step(int n) {
+    printf("step %d\r\n", n);
+    if (n != steps) {
+        handles_ok = false;
+    }
+    steps++;
+    if (n + 1 < NUM_STEPS) {
+        minar::callback_handle_t h = minar::Scheduler::postContinuation(FunctionPointer1<void, int>(step).bind(n + 1))
+            .delay(minar::milliseconds(20))
+            .tolerance(minar::milliseconds(5))
+            .getHandle();
+        if (h != first_handle) {
+            handles_ok = false;
+        }
+    } else {
+        minar::Scheduler::stop();
+    }
+}
+
+void app_start(int, char*[]) {
+    GREENTEA_SETUP(10, "default");
+
+    first_handle = minar::Scheduler::postCallback(FunctionPointer1<void, int>(step).bind(0))
+        .tolerance(minar::milliseconds(5))
+        .getHandle();
+
+    int cb_cnt = minar::Scheduler::start(); // returns after the last step
+
+    printf("Steps run: %d\r\n", steps);
+    TEST_ASSERT_EQUAL_MESSAGE(NUM_STEPS, steps, "Wrong number of steps!");
+    TEST_ASSERT_TRUE_MESSAGE(handles_ok, "Continuation did not re-use the callback node");
+    TEST_ASSERT_EQUAL_MESSAGE(0, cb_cnt, "Wrong call back count!");
+
+    GREENTEA_TESTSUITE_RESULT((steps == NUM_STEPS) && handles_ok && (cb_cnt == 0));
+}
@@ -0,0 +1,105 @@
+/*
+ * PackageLicenseDeclared: Apache-2.0
+ * Copyright (c) 2015 ARM Limited
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+// Checks that the _ms and _s duration literals convert to the same number of
+// ticks as minar::milliseconds, and that callbacks posted with Duration
+// delays, periods and tolerances are scheduled exactly like callbacks posted
+// with the same values in ticks. The literals need C++11: without it, the
+// test only reports success.
+
+#include <stdio.h>
+#include "minar/minar.h"
+#include "mbed-drivers/mbed.h"
+#include "greentea-client/test_env.h"
+#include "unity/unity.h"
+#include "core-util/FunctionPointer.h"
+
+#if __cplusplus >= 201103L
+
+using mbed::util::FunctionPointer1;
+using namespace minar::literals;
+
+static_assert((1000_ms).ticks() == minar::platform::Time_Base, "1000_ms is not one second");
+static_assert((1_s).ticks() == (1000_ms).ticks(), "1_s is not 1000_ms");
+
+#define NUM_CALLS 5
+
+struct Schedule {
+    minar::tick_t times[NUM_CALLS];
+    int calls;
+};
+
+static Schedule with_ticks;
+static Schedule with_durations;
+
+static void record(Schedule *schedule) {
+    if (schedule->calls < NUM_CALLS) {
+        schedule->times[schedule->calls++] = minar::getTime();
+    }
+    if (with_ticks.calls == NUM_CALLS && with_durations.calls == NUM_CALLS) {
+        minar::Scheduler::stop();
+    }
+}
+
+void app_start(int, char*[]) {
+    GREENTEA_SETUP(10, "default");
+
+    TEST_ASSERT_EQUAL_MESSAGE(minar::milliseconds(50), (50_ms).ticks(), "50_ms is wrong");
+    TEST_ASSERT_EQUAL_MESSAGE(minar::milliseconds(2000), (2_s).ticks(), "2_s is wrong");
+    TEST_ASSERT_EQUAL_MESSAGE(minar::milliseconds(0), (0_ms).ticks(), "0_ms is wrong");
+
+    minar::Scheduler::postCallback(FunctionPointer1<void, Schedule*>(record).bind(&with_ticks))
+        .delay(minar::milliseconds(20))
+        .period(minar::milliseconds(100))
+        .tolerance(minar::milliseconds(4));
+    minar::Scheduler::postCallback(FunctionPointer1<void, Schedule*>(record).bind(&with_durations))
+        .delay(20_ms)
+        .period(100_ms)
+        .tolerance(4_ms);
+
+    minar::Scheduler::start(); // returns after NUM_CALLS of each
+
+    // both were posted at (almost) the same time, so they should have been
+    // scheduled at the same times, give or take the time between the posts
+    bool same = true;
+    for (int i = 0; i < NUM_CALLS; i++) {
+        const minar::tick_t ticks_offset = (with_ticks.times[i] - with_ticks.times[0]) & minar::platform::Time_Mask;
+        const minar::tick_t durations_offset = (with_durations.times[i] - with_durations.times[0]) & minar::platform::Time_Mask;
+        printf("call %d: %lu %lu\r\n", i, (unsigned long)ticks_offset, (unsigned long)durations_offset);
+        if (ticks_offset != durations_offset) {
+            same = false;
+        }
+    }
+    const minar::tick_t apart = (with_durations.times[0] - with_ticks.times[0]) & minar::platform::Time_Mask;
+    if (apart > minar::milliseconds(1) && apart < minar::platform::Time_Mask - minar::milliseconds(1)) {
+        same = false;
+    }
+    TEST_ASSERT_TRUE_MESSAGE(same, "Duration and tick versions were scheduled differently");
+
+    GREENTEA_TESTSUITE_RESULT(same);
+}
+
+#else // __cplusplus >= 201103L
+
+void app_start(int, char*[]) {
+    GREENTEA_SETUP(10, "default");
+    printf("Duration literals need C++11, skipped\r\n");
+    GREENTEA_TESTSUITE_RESULT(true);
+}
+
+#endif // __cplusplus >= 201103L
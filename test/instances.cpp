@@ -0,0 +1,96 @@
+/*
+ * PackageLicenseDeclared: Apache-2.0
+ * Copyright (c) 2015 ARM Limited
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Runs two independent scheduler instances one after the other (directly
+// from app_start, without starting the default scheduler) and checks that
+// each one only dispatches its own callbacks, and that a continuation
+// posted from a callback of an instance goes to that instance.
+
+#include <stdio.h>
+#include "minar/minar.h"
+#include "mbed-drivers/mbed.h"
+#include "greentea-client/test_env.h"
+#include "unity/unity.h"
+#include "core-util/FunctionPointer.h"
+
+using mbed::util::FunctionPointer1;
+
+#define MIN_ALLOWED_CNT_A       8
+#define MAX_ALLOWED_CNT_A       11
+
+static int cnt_a;
+static int cnt_b;
+
+static void increment(int *cnt) {
+    (*cnt)++;
+}
+
+static void halt(minar::Scheduler *sched) {
+    sched->halt();
+}
+
+static void first_step(minar::Scheduler *sched) {
+    if (minar::getTime() != sched->time()) {
+        printf("getTime() is not the time of the running scheduler\r\n");
+        return;
+    }
+    cnt_b++;
+    minar::Scheduler::postContinuation(FunctionPointer1<void, int*>(increment).bind(&cnt_b))
+        .tolerance(minar::milliseconds(5));
+}
+
+void app_start(int, char*[]) {
+    GREENTEA_SETUP(10, "default");
+
+    int left_a, left_b;
+    {
+        minar::Scheduler a;
+        minar::Scheduler b;
+
+        a.post(FunctionPointer1<void, int*>(increment).bind(&cnt_a))
+            .period(minar::milliseconds(100))
+            .tolerance(minar::milliseconds(5));
+        a.post(FunctionPointer1<void, minar::Scheduler*>(halt).bind(&a))
+            .delay(minar::milliseconds(1050))
+            .tolerance(minar::milliseconds(5));
+
+        b.post(FunctionPointer1<void, minar::Scheduler*>(first_step).bind(&b))
+            .tolerance(minar::milliseconds(5));
+        b.post(FunctionPointer1<void, minar::Scheduler*>(halt).bind(&b))
+            .delay(minar::milliseconds(100))
+            .tolerance(minar::milliseconds(5));
+
+        left_a = a.run(); // only the periodic callback should be left
+        printf("a: counter %d, %d left\r\n", cnt_a, left_a);
+        TEST_ASSERT_EQUAL_MESSAGE(0, cnt_b, "Scheduler a dispatched a callback of scheduler b");
+
+        left_b = b.run();
+        printf("b: counter %d, %d left\r\n", cnt_b, left_b);
+        // a and b are destroyed here, discarding a's periodic callback
+    }
+
+    bool cnt_a_ok = (cnt_a >= MIN_ALLOWED_CNT_A) && (cnt_a <= MAX_ALLOWED_CNT_A);
+    TEST_ASSERT_TRUE_MESSAGE(cnt_a_ok, "Counter of scheduler a is out of range");
+    // the default scheduler must not have been given the continuation
+    int left_default = minar::Scheduler::stop();
+    TEST_ASSERT_EQUAL_MESSAGE(2, cnt_b, "Counter of scheduler b is wrong");
+    TEST_ASSERT_EQUAL_MESSAGE(1, left_a, "Wrong call back count for scheduler a!");
+    TEST_ASSERT_EQUAL_MESSAGE(0, left_b, "Wrong call back count for scheduler b!");
+    TEST_ASSERT_EQUAL_MESSAGE(0, left_default, "Continuation was posted to the default scheduler!");
+
+    GREENTEA_TESTSUITE_RESULT(cnt_a_ok && (cnt_b == 2) && (left_a == 1) && (left_b == 0) && (left_default == 0));
+}
@@ -0,0 +1,158 @@
+/*
+ * PackageLicenseDeclared: Apache-2.0
+ * Copyright (c) 2015 ARM Limited
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+// Posts callbacks with payloads larger than can be bound into an Event, and
+// checks that each one receives an intact copy of its payload (which must not
+// depend on the original staying in scope), and that a periodic callback
+// gets the same copy every time it runs. Also checks that the copy is
+// destroyed exactly once, both when a callback is cancelled and when a
+// one-shot callback has run.
+
+#include <stdio.h>
+#include <string.h>
+#include "minar/minar.h"
+#include "mbed-drivers/mbed.h"
+#include "greentea-client/test_env.h"
+#include "unity/unity.h"
+
+#define NUM_FRAMES 8
+#define NUM_TICKS  5
+
+struct Frame {
+    uint8_t data[100];
+    uint8_t id;
+};
+
+struct Counter {
+    uint32_t padding[20];
+    int count;
+};
+
+// counts the live copies of a payload, and how many have been destroyed
+struct Tracked {
+    Tracked() {
+        live++;
+    }
+    Tracked(Tracked const&) {
+        live++;
+    }
+    ~Tracked() {
+        live--;
+        destroyed++;
+    }
+    uint8_t padding[40];
+
+    static int live;
+    static int destroyed;
+};
+int Tracked::live;
+int Tracked::destroyed;
+
+static int frames_ok;
+static int ticks;
+static int tracked_calls;
+
+static void handle_frame(Frame& frame) {
+    bool ok = true;
+    for (unsigned i = 0; i < sizeof(frame.data); i++) {
+        if (frame.data[i] != (uint8_t)(frame.id + i)) {
+            ok = false;
+        }
+    }
+    printf("frame %d %s\r\n", frame.id, ok ? "ok" : "corrupt");
+    if (ok) {
+        frames_ok++;
+    }
+}
+
+static void tick(Counter& counter) {
+    // the payload belongs to the callback: its state is kept between calls
+    counter.count++;
+    ticks = counter.count;
+    if (counter.count == NUM_TICKS) {
+        minar::Scheduler::stop();
+    }
+}
+
+static void tracked(Tracked&) {
+    tracked_calls++;
+}
+
+static void post_frames() {
+    for (int n = 0; n < NUM_FRAMES; n++) {
+        Frame frame;
+        frame.id = n;
+        for (unsigned i = 0; i < sizeof(frame.data); i++) {
+            frame.data[i] = (uint8_t)(n + i);
+        }
+        minar::Scheduler::postCallback(handle_frame, frame).delay(minar::milliseconds(10 * n));
+    }
+    // overwrite the stack where the frames were, to catch any reference to
+    // the originals
+    volatile uint8_t scratch[sizeof(Frame) * 2];
+    memset((void*)scratch, 0xaa, sizeof(scratch));
+}
+
+void app_start(int, char*[]) {
+    GREENTEA_SETUP(10, "default");
+
+    post_frames();
+
+    // a cancelled callback destroys its payload exactly once
+    minar::callback_handle_t handle;
+    {
+        Tracked original;
+        handle = minar::Scheduler::postCallback(tracked, original)
+            .delay(minar::milliseconds(100))
+            .getHandle();
+    }
+    const int live_before_cancel = Tracked::live;
+    const int destroyed_before_cancel = Tracked::destroyed;
+    minar::Scheduler::cancelCallback(handle);
+    const bool cancel_ok = (live_before_cancel == 1) && (Tracked::live == 0) &&
+                           (Tracked::destroyed == destroyed_before_cancel + 1);
+    printf("Cancelled payload: %d live before, %d after, %d destroyed\r\n",
+        live_before_cancel, Tracked::live, Tracked::destroyed - destroyed_before_cancel);
+    TEST_ASSERT_TRUE_MESSAGE(cancel_ok, "Payload of a cancelled callback was not destroyed exactly once");
+
+    // ... and so does a one-shot callback that has run
+    {
+        Tracked original;
+        minar::Scheduler::postCallback(tracked, original).delay(minar::milliseconds(50));
+    }
+    const int destroyed_before_dispatch = Tracked::destroyed;
+
+    Counter counter;
+    counter.count = 0;
+    minar::Scheduler::postCallback(tick, counter)
+        .period(minar::milliseconds(200))
+        .tolerance(minar::milliseconds(5));
+
+    minar::Scheduler::start(); // returns after the last tick
+
+    const bool dispatch_ok = (tracked_calls == 1) && (Tracked::live == 0) &&
+                             (Tracked::destroyed == destroyed_before_dispatch + 1);
+
+    printf("Frames ok: %d, ticks: %d\r\n", frames_ok, ticks);
+    TEST_ASSERT_EQUAL_MESSAGE(NUM_FRAMES, frames_ok, "Corrupt or missing frames!");
+    TEST_ASSERT_EQUAL_MESSAGE(NUM_TICKS, ticks, "Periodic payload not preserved!");
+    TEST_ASSERT_EQUAL_MESSAGE(1, tracked_calls, "Cancelled callback ran, or one-shot callback didn't");
+    TEST_ASSERT_TRUE_MESSAGE(dispatch_ok, "Payload of a one-shot callback was not destroyed exactly once");
+
+    GREENTEA_TESTSUITE_RESULT((frames_ok == NUM_FRAMES) && (ticks == NUM_TICKS) && cancel_ok && dispatch_ok);
+}
@@ -0,0 +1,97 @@
+/*
+ * PackageLicenseDeclared: Apache-2.0
+ * Copyright (c) 2015 ARM Limited
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+// Posts a burst of callbacks one larger than the free space in the event
+// pool, and checks that the pool statistics count them, record the
+// high-water mark, and show exactly one growth of the pool. Once they have
+// all run, checks that they have been returned to the pool.
+
+#include <stdio.h>
+#include "minar/minar.h"
+#include "mbed-drivers/mbed.h"
+#include "greentea-client/test_env.h"
+#include "unity/unity.h"
+#include "core-util/FunctionPointer.h"
+
+using mbed::util::FunctionPointer0;
+
+static uint32_t burst;
+static uint32_t calls;
+static minar::PoolStats before;
+static minar::PoolStats after_burst;
+static minar::PoolStats after_dispatch;
+
+static void count() {
+    calls++;
+}
+
+static void finish() {
+    after_dispatch = minar::Scheduler::getPoolStats();
+    minar::Scheduler::stop();
+}
+
+void app_start(int, char*[]) {
+    GREENTEA_SETUP(10, "default");
+
+    // create the scheduler (and pre-warm the pool, if configured) first
+    minar::Scheduler::instance();
+    before = minar::Scheduler::getPoolStats();
+    burst = before.capacity - before.in_use + 1;
+
+    for (uint32_t i = 0; i < burst; i++) {
+        minar::Scheduler::postCallback(FunctionPointer0<void>(count).bind())
+            .delay(minar::milliseconds(10))
+            .tolerance(minar::milliseconds(5));
+    }
+    minar::Scheduler::postCallback(FunctionPointer0<void>(finish).bind())
+        .delay(minar::milliseconds(200))
+        .tolerance(minar::milliseconds(5));
+    after_burst = minar::Scheduler::getPoolStats();
+
+    minar::Scheduler::start(); // returns when finish() runs
+
+    printf("before: in use %lu, high water %lu, capacity %lu, growths %lu\r\n",
+        (unsigned long)before.in_use, (unsigned long)before.high_water,
+        (unsigned long)before.capacity, (unsigned long)before.growths);
+    printf("burst of %lu: in use %lu, high water %lu, capacity %lu, growths %lu\r\n",
+        (unsigned long)burst, (unsigned long)after_burst.in_use, (unsigned long)after_burst.high_water,
+        (unsigned long)after_burst.capacity, (unsigned long)after_burst.growths);
+    printf("dispatched %lu: in use %lu, high water %lu\r\n",
+        (unsigned long)calls, (unsigned long)after_dispatch.in_use, (unsigned long)after_dispatch.high_water);
+
+    const uint32_t peak = before.in_use + burst + 1;
+    bool burst_ok = (after_burst.in_use == peak) &&
+                    (after_burst.high_water == peak) &&
+                    (after_burst.growths == before.growths + 1) &&
+                    (after_burst.capacity >= peak);
+    TEST_ASSERT_EQUAL_MESSAGE(peak, after_burst.in_use, "Wrong number of callbacks in use after the burst");
+    TEST_ASSERT_EQUAL_MESSAGE(peak, after_burst.high_water, "Wrong high-water mark after the burst");
+    TEST_ASSERT_EQUAL_MESSAGE(before.growths + 1, after_burst.growths, "Pool did not grow exactly once");
+
+    // only finish() itself is still allocated, and the high-water mark isn't
+    // affected by the pool growing in advance while the scheduler was idle
+    bool dispatch_ok = (calls == burst) &&
+                       (after_dispatch.in_use == before.in_use + 1) &&
+                       (after_dispatch.high_water == peak) &&
+                       (after_dispatch.growths == after_burst.growths);
+    TEST_ASSERT_EQUAL_MESSAGE(burst, calls, "Wrong number of callbacks dispatched");
+    TEST_ASSERT_EQUAL_MESSAGE(before.in_use + 1, after_dispatch.in_use, "Callbacks were not returned to the pool");
+    TEST_ASSERT_EQUAL_MESSAGE(peak, after_dispatch.high_water, "High-water mark changed while idle");
+
+    GREENTEA_TESTSUITE_RESULT(burst_ok && dispatch_ok);
+}
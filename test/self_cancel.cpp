@@ -0,0 +1,80 @@
+/*
+ * PackageLicenseDeclared: Apache-2.0
+ * Copyright (c) 2015 ARM Limited
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+// A periodic callback cancels itself, then posts a new callback (which is
+// likely to be given the memory of the cancelled one if that was freed too
+// early). Checks that the periodic callback stops after cancelling itself,
+// and that the new callback runs.
+
+#include <stdio.h>
+#include "minar/minar.h"
+#include "mbed-drivers/mbed.h"
+#include "greentea-client/test_env.h"
+#include "unity/unity.h"
+#include "core-util/FunctionPointer.h"
+
+using mbed::util::FunctionPointer0;
+
+#define NUM_CALLS 3
+
+static int calls;
+static bool replacement_run;
+static minar::callback_handle_t periodic_handle;
+
+static void finish() {
+    minar::Scheduler::stop();
+}
+
+static void replacement() {
+    printf("replacement\r\n");
+    replacement_run = true;
+}
+
+static void periodic() {
+    calls++;
+    printf("periodic %d\r\n", calls);
+    if (calls == NUM_CALLS) {
+        minar::Scheduler::cancelCallback(periodic_handle);
+        minar::Scheduler::postCallback(FunctionPointer0<void>(replacement).bind())
+            .delay(minar::milliseconds(50))
+            .tolerance(minar::milliseconds(5));
+        // leave time for the periodic callback to run again if it wasn't
+        // cancelled
+        minar::Scheduler::postCallback(FunctionPointer0<void>(finish).bind())
+            .delay(minar::milliseconds(500))
+            .tolerance(minar::milliseconds(5));
+    }
+}
+
+void app_start(int, char*[]) {
+    GREENTEA_SETUP(10, "default");
+
+    periodic_handle = minar::Scheduler::postCallback(FunctionPointer0<void>(periodic).bind())
+        .period(minar::milliseconds(100))
+        .tolerance(minar::milliseconds(5))
+        .getHandle();
+
+    int cb_cnt = minar::Scheduler::start(); // returns when finish() runs
+
+    printf("Periodic calls: %d\r\n", calls);
+    TEST_ASSERT_EQUAL_MESSAGE(NUM_CALLS, calls, "Periodic callback ran after cancelling itself!");
+    TEST_ASSERT_TRUE_MESSAGE(replacement_run, "Callback posted after the cancellation did not run");
+    TEST_ASSERT_EQUAL_MESSAGE(0, cb_cnt, "Wrong call back count!");
+
+    GREENTEA_TESTSUITE_RESULT((calls == NUM_CALLS) && replacement_run && (cb_cnt == 0));
+}